@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <malloc.h>             // malloc_usable_size
+#include "alloc.h"
+#include "scheduler.h"
+
+#ifdef NO_ALLOC_STATS
+
+void alloc_report(void) {
+    printf("meminfo: allocation accounting compiled out (NO_ALLOC_STATS)\n");
+}
+
+#else
+
+// Counters of one subsystem. Updated with relaxed atomics: MT workers and
+// the async exec thread allocate concurrently, and a report only needs
+// each counter to be consistent on its own.
+struct AllocCounters {
+    uint64_t allocs;
+    uint64_t frees;
+    int64_t live_bytes;
+    int64_t peak_bytes;
+};
+
+static struct AllocCounters counters[ALLOC_TAGS];
+
+static const char *const tag_names[ALLOC_TAGS] = {
+    [ALLOC_VARS] = "vars",
+    [ALLOC_PROGRAM] = "program",
+    [ALLOC_SCHEDULER] = "scheduler",
+    [ALLOC_RUN] = "run",
+};
+
+static void account_alloc(AllocTag tag, void *p) {
+    struct AllocCounters *c = &counters[tag];
+    int64_t live = __atomic_add_fetch(&c->live_bytes, malloc_usable_size(p), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->allocs, 1, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&c->peak_bytes, __ATOMIC_RELAXED);
+    while (live > peak && !__atomic_compare_exchange_n(&c->peak_bytes, &peak, live, 1,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static void account_free(AllocTag tag, void *p) {
+    struct AllocCounters *c = &counters[tag];
+    __atomic_sub_fetch(&c->live_bytes, malloc_usable_size(p), __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->frees, 1, __ATOMIC_RELAXED);
+}
+
+void *alloc_malloc(AllocTag tag, size_t size) {
+    void *p = malloc(size);
+    if (p != NULL) {
+        account_alloc(tag, p);
+    }
+    return p;
+}
+
+void *alloc_calloc(AllocTag tag, size_t n, size_t size) {
+    void *p = calloc(n, size);
+    if (p != NULL) {
+        account_alloc(tag, p);
+    }
+    return p;
+}
+
+void *alloc_realloc(AllocTag tag, void *p, size_t size) {
+    size_t old = p ? malloc_usable_size(p) : 0;
+    void *grown = realloc(p, size);
+    if (grown == NULL) {
+        return NULL;
+    }
+    // Counted as a free of the old block and an allocation of the new one
+    if (p != NULL) {
+        __atomic_sub_fetch(&counters[tag].live_bytes, old, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&counters[tag].frees, 1, __ATOMIC_RELAXED);
+    }
+    account_alloc(tag, grown);
+    return grown;
+}
+
+char *alloc_strdup(AllocTag tag, const char *s) {
+    char *p = strdup(s);
+    if (p != NULL) {
+        account_alloc(tag, p);
+    }
+    return p;
+}
+
+void alloc_free(AllocTag tag, void *p) {
+    if (p != NULL) {
+        account_free(tag, p);
+        free(p);
+    }
+}
+
+void alloc_report(void) {
+    struct AllocCounters total = { 0, 0, 0, 0 };
+    printf("%-10s %10s %10s %11s %11s %11s\n",
+           "SUBSYSTEM", "ALLOCS", "FREES", "LIVE_BLOCKS", "LIVE_BYTES", "PEAK_BYTES");
+    for (int t = 0; t < ALLOC_TAGS; t++) {
+        struct AllocCounters c;
+        c.allocs = __atomic_load_n(&counters[t].allocs, __ATOMIC_RELAXED);
+        c.frees = __atomic_load_n(&counters[t].frees, __ATOMIC_RELAXED);
+        c.live_bytes = __atomic_load_n(&counters[t].live_bytes, __ATOMIC_RELAXED);
+        c.peak_bytes = __atomic_load_n(&counters[t].peak_bytes, __ATOMIC_RELAXED);
+        printf("%-10s %10llu %10llu %11lld %11lld %11lld\n", tag_names[t],
+               (unsigned long long)c.allocs, (unsigned long long)c.frees,
+               (long long)(c.allocs - c.frees), (long long)c.live_bytes,
+               (long long)c.peak_bytes);
+        total.allocs += c.allocs;
+        total.frees += c.frees;
+        total.live_bytes += c.live_bytes;
+        total.peak_bytes += c.peak_bytes;   // sum of peaks: an upper bound
+    }
+    printf("%-10s %10llu %10llu %11lld %11lld %11lld\n", "total",
+           (unsigned long long)total.allocs, (unsigned long long)total.frees,
+           (long long)(total.allocs - total.frees), (long long)total.live_bytes,
+           (long long)total.peak_bytes);
+    uint64_t instructions = scheduler_instruction_clock();
+    printf("instructions %llu, %.2f allocations per instruction\n",
+           (unsigned long long)instructions,
+           instructions ? (double)total.allocs / instructions : 0.0);
+}
+
+#endif // NO_ALLOC_STATS
@@ -0,0 +1,51 @@
+#ifndef ALLOC_H
+#define ALLOC_H
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Subsystem an allocation is charged to.
+ */
+typedef enum {
+    ALLOC_VARS,                 // Shell variables and mem_get_value copies
+    ALLOC_PROGRAM,              // Program line arena chunks
+    ALLOC_SCHEDULER,            // PCBs, live table, pid index, ready heap
+    ALLOC_RUN,                  // run argument vectors
+    ALLOC_TAGS
+} AllocTag;
+
+// Build with -DNO_ALLOC_STATS to compile the accounting out: the wrappers
+// become the plain libc calls and meminfo --alloc says so.
+#ifdef NO_ALLOC_STATS
+
+#define alloc_malloc(tag, size) malloc(size)
+#define alloc_calloc(tag, n, size) calloc((n), (size))
+#define alloc_realloc(tag, p, size) realloc((p), (size))
+#define alloc_strdup(tag, s) strdup(s)
+#define alloc_free(tag, p) free(p)
+
+#else
+
+/**
+ * Counting wrappers around malloc, calloc, realloc, strdup and free. Each
+ * call is charged to a subsystem; live bytes are the usable size of the
+ * blocks. A block must be freed (or reallocated) with the tag it was
+ * allocated with.
+ *
+ * @param tag AllocTag of the caller
+ */
+void *alloc_malloc(AllocTag tag, size_t size);
+void *alloc_calloc(AllocTag tag, size_t n, size_t size);
+void *alloc_realloc(AllocTag tag, void *p, size_t size);
+char *alloc_strdup(AllocTag tag, const char *s);
+void alloc_free(AllocTag tag, void *p);
+
+#endif // NO_ALLOC_STATS
+
+/**
+ * Print allocations, frees, live blocks, live and peak bytes per subsystem,
+ * and allocations per instruction executed.
+ */
+void alloc_report(void);
+
+#endif // ALLOC_H
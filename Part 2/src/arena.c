@@ -0,0 +1,61 @@
+#include <string.h>
+#include "arena.h"
+
+struct ArenaChunk {
+    struct ArenaChunk *next;
+    size_t size;                // Bytes of data
+    size_t used;
+    char data[];
+};
+
+void *arena_alloc(struct Arena *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    struct ArenaChunk *chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+        size_t chunk_size = chunk ? chunk->size * 2 : ARENA_CHUNK_MIN;
+        if (chunk_size > ARENA_CHUNK_SIZE) {
+            chunk_size = ARENA_CHUNK_SIZE;
+        }
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+        chunk = alloc_malloc(arena->tag, sizeof(struct ArenaChunk) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    void *p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+char *arena_strdup(struct Arena *arena, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *p = arena_alloc(arena, len);
+    if (p != NULL) {
+        memcpy(p, s, len);
+    }
+    return p;
+}
+
+void arena_release(struct Arena *arena) {
+    struct ArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL) {
+        struct ArenaChunk *next = chunk->next;
+        alloc_free(arena->tag, chunk);
+        chunk = next;
+    }
+    arena->chunks = NULL;
+}
+
+void arena_usage(const struct Arena *arena, size_t *used, size_t *held) {
+    *used = *held = 0;
+    for (struct ArenaChunk *chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+        *used += chunk->used;
+        *held += chunk->size;
+    }
+}
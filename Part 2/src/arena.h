@@ -0,0 +1,55 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+#include "alloc.h"
+
+// Chunk sizes: the first chunk of an arena is ARENA_CHUNK_MIN bytes and
+// each new one doubles, up to ARENA_CHUNK_SIZE (larger requests get a
+// chunk of their own). Small arenas stay small.
+#define ARENA_CHUNK_MIN 1024
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct ArenaChunk;
+
+/**
+ * Region allocator: allocations are bumped out of large chunks and are
+ * never freed one by one; arena_release frees all of them at once. Each
+ * program segment owns one arena and releases it with the segment. Not
+ * thread-safe: the owner serializes use, as it does for the data itself.
+ */
+struct Arena {
+    struct ArenaChunk *chunks;  // Newest first
+    AllocTag tag;               // Subsystem the chunks are charged to
+};
+
+#define ARENA_INIT(tag) { NULL, (tag) }
+
+/**
+ * @param arena Arena to allocate from
+ * @param size  Bytes wanted
+ * @return 8-byte aligned memory valid until arena_release, or NULL
+ */
+void *arena_alloc(struct Arena *arena, size_t size);
+
+/**
+ * @param arena Arena to allocate from
+ * @param s     String to copy
+ * @return Copy of s in the arena, or NULL
+ */
+char *arena_strdup(struct Arena *arena, const char *s);
+
+/**
+ * Free every chunk. The arena is empty and can be used again.
+ *
+ * @param arena Arena to release
+ */
+void arena_release(struct Arena *arena);
+
+/**
+ * @param arena Arena
+ * @param used  Receives bytes handed out
+ * @param held  Receives bytes of chunks held
+ */
+void arena_usage(const struct Arena *arena, size_t *used, size_t *held);
+
+#endif // ARENA_H
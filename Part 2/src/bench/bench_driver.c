@@ -0,0 +1,115 @@
+// Benchmark driver: runs mysh on one input file several times and reports
+// latency percentiles, instruction throughput and peak RSS as one CSV row.
+//
+// Usage: bench_driver MYSH INPUT RUNS EXECS_PER_RUN INSTRUCTIONS_PER_EXEC
+//
+// Output (no header):
+//   run_p50_us,run_p90_us,run_p99_us,run_max_us,instr_per_sec,peak_rss_kb
+// One sample per run: the wall time of the mysh run (start-up included)
+// divided by the number of exec commands in INPUT. The percentiles are
+// over these per-run means, not over individual execs: stdout is
+// buffered, so the driver cannot see where one exec ends. Throughput uses
+// the median run.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of a sorted array
+static double percentile(double *sorted, int n, int pct) {
+    int rank = (pct * n + 99) / 100;
+    if (rank < 1) rank = 1;
+    return sorted[rank - 1];
+}
+
+// Run mysh once with stdin from input; returns wall time in us, -1 on error.
+static double run_once(const char *mysh, const char *input, long *rss_kb) {
+    double start = now_us();
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork() failed");
+        return -1;
+    }
+    if (pid == 0) {
+        int in = open(input, O_RDONLY);
+        int null = open("/dev/null", O_WRONLY);
+        if (in < 0 || null < 0) {
+            perror("bench_driver: open");
+            _exit(127);
+        }
+        dup2(in, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execl(mysh, mysh, (char *)NULL);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) {
+        perror("wait4 failed");
+        return -1;
+    }
+    double elapsed = now_us() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "bench_driver: %s failed on %s\n", mysh, input);
+        return -1;
+    }
+    *rss_kb = ru.ru_maxrss;
+    return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 6) {
+        fprintf(stderr, "usage: %s MYSH INPUT RUNS EXECS_PER_RUN INSTRUCTIONS_PER_EXEC\n", argv[0]);
+        return 2;
+    }
+    const char *mysh = argv[1];
+    const char *input = argv[2];
+    int runs = atoi(argv[3]);
+    int execs = atoi(argv[4]);
+    long instructions = atol(argv[5]);
+    if (runs < 1 || execs < 1) {
+        fprintf(stderr, "bench_driver: RUNS and EXECS_PER_RUN must be positive\n");
+        return 2;
+    }
+
+    // Mean time per exec of each run
+    double *lat = malloc(runs * sizeof(double));
+    long peak_rss = 0;
+    for (int i = 0; i < runs; i++) {
+        long rss = 0;
+        double t = run_once(mysh, input, &rss);
+        if (t < 0) {
+            return 1;
+        }
+        lat[i] = t / execs;
+        if (rss > peak_rss) peak_rss = rss;
+    }
+
+    qsort(lat, runs, sizeof(double), compare_double);
+    double p50 = percentile(lat, runs, 50);
+    double instr_per_sec = p50 > 0 ? instructions / (p50 / 1e6) : 0;
+    printf("%.1f,%.1f,%.1f,%.1f,%.0f,%ld\n",
+           p50, percentile(lat, runs, 90), percentile(lat, runs, 99),
+           lat[runs - 1], instr_per_sec, peak_rss);
+
+    free(lat);
+    return 0;
+}
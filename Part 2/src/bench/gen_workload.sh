@@ -0,0 +1,60 @@
+#!/bin/bash
+# Generate synthetic programs for the benchmark suite.
+# Usage: ./gen_workload.sh OUTDIR
+#
+# Each workload is three programs OUTDIR/<name>_1 .. <name>_3 plus
+# OUTDIR/<name>.meta holding "<execs per run> <instructions per exec>".
+# Shell memory holds 1000 program lines, so one exec can load at most
+# ~330 lines per program.
+#
+#   echo      echo-heavy, 300 lines per program
+#   setprint  set/print pairs, 300 lines per program
+#   mixed     echo, set, print and echo $VAR, 300 lines per program
+#   tiny      3-line programs, exec'd 100 times per run
+#   huge      330-line programs (fills program memory), one exec per run
+
+set -e
+OUT="${1:-work}"
+mkdir -p "$OUT"
+
+gen() {
+    # gen NAME LINES KIND
+    local name=$1 lines=$2 kind=$3
+    for p in 1 2 3; do
+        local f="$OUT/${name}_$p"
+        : > "$f"
+        for ((i = 0; i < lines; i++)); do
+            case $kind in
+            echo)
+                echo "echo P${p}L$i" >> "$f"
+                ;;
+            setprint)
+                if ((i % 2 == 0)); then
+                    echo "set v$p$((i % 50)) value$i" >> "$f"
+                else
+                    echo "print v$p$(((i - 1) % 50))" >> "$f"
+                fi
+                ;;
+            mixed)
+                case $((i % 4)) in
+                0) echo "echo P${p}L$i" >> "$f" ;;
+                1) echo "set m$p$((i % 20)) x$i" >> "$f" ;;
+                2) echo "print m$p$(((i - 1) % 20))" >> "$f" ;;
+                3) echo "echo \$m$p$(((i - 2) % 20))" >> "$f" ;;
+                esac
+                ;;
+            esac
+        done
+    done
+}
+
+gen echo 300 echo
+echo "1 900" > "$OUT/echo.meta"
+gen setprint 300 setprint
+echo "1 900" > "$OUT/setprint.meta"
+gen mixed 300 mixed
+echo "1 900" > "$OUT/mixed.meta"
+gen tiny 3 echo
+echo "100 9" > "$OUT/tiny.meta"
+gen huge 330 mixed
+echo "1 990" > "$OUT/huge.meta"
@@ -0,0 +1,158 @@
+// Directory listing micro-benchmark. Fills a scratch directory with N
+// files and times the old my_ls engine (scandir + per-character
+// comparator) against listing.c (getdents64 + memcmp sort keys), then
+// checks that the new order is a valid sort under the old comparator.
+//
+// Usage: bench/ls_bench [FILES] [DIR]
+//
+// FILES defaults to 100000, DIR to a fresh directory under /tmp (removed
+// afterwards). Output is CSV, one row per engine:
+//   engine,files,ms_per_listing
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "../listing.h"
+
+#define RUNS 5
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The comparator my_ls used before listing.c
+static int ls_compare_char(char a, char b) {
+    if (isdigit(a) && isdigit(b)) {
+        return a - b;
+    }
+    if (isdigit(a)) {
+        return -1;
+    }
+    char lower_a = tolower(a), lower_b = tolower(b);
+    if (lower_a == lower_b) {
+        return a - b;
+    }
+    return lower_a - lower_b;
+}
+
+static int ls_compare_str(const char *a, const char *b) {
+    while (*a != '\0') {
+        int d = ls_compare_char(*a, *b);
+        if (d != 0) return d;
+        a++, b++;
+    }
+    return ls_compare_char(*a, *b);
+}
+
+static int ls_compare(const struct dirent **a, const struct dirent **b) {
+    return ls_compare_str((*a)->d_name, (*b)->d_name);
+}
+
+// Deterministic xorshift so runs are comparable
+static unsigned rng_state = 2463534242u;
+static unsigned rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static void fill(const char *dir, int files) {
+    static const char alphabet[] =
+        "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    char name[64];
+    for (int i = 0; i < files; i++) {
+        // Random alphanumeric names with a unique numeric suffix
+        int len = 1 + rng() % 12;
+        int n = snprintf(name, sizeof(name), "%s/", dir);
+        for (int j = 0; j < len; j++) {
+            name[n++] = alphabet[rng() % (sizeof(alphabet) - 1)];
+        }
+        snprintf(name + n, sizeof(name) - n, "%d", i);
+        int fd = open(name, O_WRONLY | O_CREAT, 0644);
+        if (fd < 0) {
+            perror(name);
+            exit(1);
+        }
+        close(fd);
+    }
+}
+
+static void cleanup(const char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *e;
+    char path[PATH_MAX];
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+int main(int argc, char *argv[]) {
+    int files = argc > 1 ? atoi(argv[1]) : 100000;
+    char dir[PATH_MAX];
+    if (argc > 2) {
+        snprintf(dir, sizeof(dir), "%s", argv[2]);
+        mkdir(dir, 0755);
+    } else {
+        snprintf(dir, sizeof(dir), "/tmp/ls_bench.XXXXXX");
+        if (mkdtemp(dir) == NULL) {
+            perror("mkdtemp failed");
+            return 1;
+        }
+    }
+    fill(dir, files);
+    FILE *sink = fopen("/dev/null", "w");
+
+    printf("engine,files,ms_per_listing\n");
+    double start = now_ns();
+    for (int r = 0; r < RUNS; r++) {
+        struct dirent **namelist;
+        int n = scandir(dir, &namelist, NULL, ls_compare);
+        for (int i = 0; i < n; i++) {
+            fprintf(sink, "%s\n", namelist[i]->d_name);
+            free(namelist[i]);
+        }
+        free(namelist);
+    }
+    printf("scandir,%d,%.2f\n", files, (now_ns() - start) / RUNS / 1e6);
+
+    struct Listing listing;
+    start = now_ns();
+    for (int r = 0; r < RUNS; r++) {
+        int fd = open(dir, O_RDONLY | O_DIRECTORY);
+        listing_read(fd, &listing);
+        close(fd);
+        listing_write(&listing, sink);
+        if (r < RUNS - 1) {
+            listing_free(&listing);
+        }
+    }
+    printf("getdents64,%d,%.2f\n", files, (now_ns() - start) / RUNS / 1e6);
+
+    int bad = 0;
+    for (int i = 1; i < listing.count; i++) {
+        if (ls_compare_str(listing.entries[i - 1].name, listing.entries[i].name) >= 0) {
+            fprintf(stderr, "order differs: %s before %s\n",
+                    listing.entries[i - 1].name, listing.entries[i].name);
+            bad = 1;
+            break;
+        }
+    }
+    listing_free(&listing);
+    fclose(sink);
+    cleanup(dir);
+    return bad;
+}
@@ -0,0 +1,181 @@
+// Ready-queue micro-benchmark. Links scheduler.c directly and measures the
+// cost of each queue operation at queue depths from 3 to 100k PCBs.
+//
+// Usage: bench/rq_bench [MAX_DEPTH]
+//
+// Output is CSV, one row per (operation, depth, threads):
+//   op,depth,threads,ops,ns_per_op
+// Plot ns_per_op against depth per op to get the scaling curves.
+//
+// Every measurement runs at a steady depth: the queue is filled to depth
+// PCBs, then each timed op removes one PCB and puts one back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include "../scheduler.h"
+#include "../stats.h"
+
+static const int depths[] = { 3, 10, 100, 1000, 10000, 100000 };
+static const int thread_counts[] = { 1, 2, 4 };
+
+// Deterministic xorshift so runs are comparable
+static uint32_t rng_state = 2463534242u;
+static uint32_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Keep each measurement around 2e7 queue-node visits (at least 100 ops)
+static long ops_for(int depth, int linear) {
+    long ops = linear ? 20000000L / depth : 1000000L;
+    if (ops < 100) ops = 100;
+    if (ops > 1000000L) ops = 1000000L;
+    return ops;
+}
+
+static void report(const char *op, int depth, int threads, long ops, double ns) {
+    printf("%s,%d,%d,%ld,%.1f\n", op, depth, threads, ops, ns / ops);
+    fflush(stdout);
+}
+
+// Fill the queue with depth PCBs whose scores ascend, so the list is a
+// valid AGING queue without paying for sorted inserts.
+static void fill(int depth) {
+    ready_queue_init();
+    for (int i = 0; i < depth; i++) {
+        struct PCB *pcb = pcb_create(0, i);
+        ready_queue_enqueue(pcb);
+    }
+}
+
+static void drain(void) {
+    while (!ready_queue_is_empty()) {
+        pcb_free(ready_queue_dequeue());
+    }
+}
+
+static void bench_fifo(int depth) {
+    fill(depth);
+    long ops = ops_for(depth, 0);
+    double start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        ready_queue_enqueue(ready_queue_dequeue());
+    }
+    report("enqueue+dequeue", depth, 1, ops, now_ns() - start);
+    drain();
+}
+
+static void bench_aging(int depth, int reinsert) {
+    fill(depth);
+    long ops = ops_for(depth, 1);
+    double start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        struct PCB *pcb = ready_queue_dequeue();
+        pcb->job_length_score = rng() % depth;
+        ready_queue_enqueue_aging(pcb, reinsert);
+    }
+    report(reinsert ? "enqueue_aging_reinsert" : "enqueue_aging_initial",
+           depth, 1, ops, now_ns() - start);
+    drain();
+}
+
+static void bench_age(int depth) {
+    fill(depth);
+    long ops = ops_for(depth, 1);
+    double start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        ready_queue_age();
+    }
+    report("age", depth, 1, ops, now_ns() - start);
+    drain();
+}
+
+// FAIR red-black tree: pick the leftmost job, charge it one instruction,
+// put it back
+static void bench_fair(int depth) {
+    ready_queue_init();
+    ready_queue_policy_reset();
+    for (int i = 0; i < depth; i++) {
+        struct PCB *pcb = pcb_create(0, 1);
+        pcb->weight = 1 + rng() % 4;
+        ready_queue_enqueue_fair(pcb, 0);
+    }
+    long ops = ops_for(depth, 0);
+    double start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        struct PCB *pcb = ready_queue_dequeue_policy(POLICY_FAIR);
+        pcb->instructions++;
+        ready_queue_enqueue_fair(pcb, 1);
+    }
+    report("fair_pick+reinsert", depth, 1, ops, now_ns() - start);
+    while (!ready_queue_is_empty()) {
+        pcb_free(ready_queue_dequeue_policy(POLICY_FAIR));
+    }
+}
+
+struct MtArgs {
+    long ops;
+};
+
+static void *mt_thread(void *arg) {
+    struct MtArgs *a = arg;
+    uint64_t now = stats_now();
+    for (long i = 0; i < a->ops; i++) {
+        struct PCB *pcb = ready_queue_mt_dequeue_blocking(&now);
+        ready_queue_mt_enqueue(pcb);
+        ready_queue_mt_worker_done();
+    }
+    return NULL;
+}
+
+static void bench_mt(int depth, int threads) {
+    ready_queue_mt_init();
+    ready_queue_init();
+    // Every thread holds at most one PCB, so the queue never runs dry
+    for (int i = 0; i < depth + threads; i++) {
+        ready_queue_mt_enqueue(pcb_create(0, i));
+    }
+
+    long ops = ops_for(depth, 0) / threads;
+    pthread_t tids[8];
+    struct MtArgs args = { ops };
+    double start = now_ns();
+    for (int t = 0; t < threads; t++) {
+        pthread_create(&tids[t], NULL, mt_thread, &args);
+    }
+    for (int t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+    }
+    report("mt_enqueue+dequeue", depth, threads, ops * threads, now_ns() - start);
+    drain();
+}
+
+int main(int argc, char *argv[]) {
+    int max_depth = argc > 1 ? atoi(argv[1]) : 100000;
+
+    printf("op,depth,threads,ops,ns_per_op\n");
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        int depth = depths[d];
+        if (depth > max_depth) break;
+        bench_fifo(depth);
+        bench_aging(depth, 0);
+        bench_aging(depth, 1);
+        bench_age(depth);
+        bench_fair(depth);
+        for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+            bench_mt(depth, thread_counts[t]);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#!/bin/bash
+# End-to-end workload benchmarks for mysh.
+#
+# Usage: cd bench && ./run_bench.sh [RUNS]
+#            Runs every workload under every policy (RR/RR30 also with MT)
+#            and writes results/<commit>.csv (and prints it).
+#        ./run_bench.sh compare OLD.csv NEW.csv
+#            Shows the change in median latency and throughput per row.
+#
+# Or from src/: make bench
+
+set -e
+cd "$(dirname "$0")"
+
+if [ "$1" == "compare" ]; then
+    if [ $# -ne 3 ]; then
+        echo "usage: $0 compare OLD.csv NEW.csv"
+        exit 2
+    fi
+    awk -F, '
+        FNR == 1 { next }
+        NR == FNR { p50[$1","$2","$3] = $4; ips[$1","$2","$3] = $8; next }
+        ($1","$2","$3) in p50 {
+            k = $1","$2","$3
+            printf "%-10s %-6s %-3s run p50 %9.1f -> %9.1f us (%+6.1f%%)  instr/s %+6.1f%%\n",
+                   $1, $2, $3, p50[k], $4, ($4 - p50[k]) * 100 / p50[k],
+                   ($8 - ips[k]) * 100 / ips[k]
+        }' "$2" "$3"
+    exit 0
+fi
+
+RUNS="${1:-20}"
+MYSH="$(pwd)/../mysh"
+DRIVER="$(pwd)/bench_driver"
+WORK=work
+POLICIES="FCFS SJF RR RR30 AGING"
+
+if [ ! -x "$MYSH" ] || [ ! -x "$DRIVER" ]; then
+    echo "build first: make mysh bench/bench_driver"
+    exit 1
+fi
+
+./gen_workload.sh "$WORK"
+mkdir -p results
+COMMIT=$(git rev-parse --short HEAD 2>/dev/null || echo unknown)
+OUT="results/$COMMIT.csv"
+
+# run_*_us: percentiles over runs of (run wall time / execs per run)
+echo "workload,policy,mt,run_p50_us,run_p90_us,run_p99_us,run_max_us,instr_per_sec,peak_rss_kb" > "$OUT"
+for meta in "$WORK"/*.meta; do
+    wl=$(basename "$meta" .meta)
+    read -r execs instr < "$meta"
+    for policy in $POLICIES; do
+        for mt in no yes; do
+            flag=""
+            if [ "$mt" == "yes" ]; then
+                # exec only accepts MT for the round-robin policies
+                if [ "$policy" != "RR" ] && [ "$policy" != "RR30" ]; then
+                    continue
+                fi
+                flag=" MT"
+            fi
+            input="$WORK/${wl}_${policy}_$mt.in"
+            : > "$input"
+            for ((i = 0; i < execs; i++)); do
+                echo "exec ${wl}_1 ${wl}_2 ${wl}_3 $policy$flag" >> "$input"
+            done
+            row=$(cd "$WORK" && "$DRIVER" "$MYSH" "$(basename "$input")" "$RUNS" "$execs" "$instr")
+            echo "$wl,$policy,$mt,$row" >> "$OUT"
+        done
+    done
+done
+
+cat "$OUT"
+echo "results written to bench/$OUT"
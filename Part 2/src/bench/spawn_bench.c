@@ -0,0 +1,96 @@
+// Process-spawn micro-benchmark. Compares the two ways `run` can start a
+// child: fork + execvp (the old path) and posix_spawnp (the current one),
+// with a small and a large amount of memory resident in the parent.
+//
+// Usage: bench/spawn_bench [COUNT] [PROGRAM]
+//
+// COUNT defaults to 10000 spawns per row, PROGRAM to /bin/true.
+// Output is CSV, one row per (method, resident size):
+//   method,resident_mb,count,us_per_spawn
+//
+// fork has to copy the parent's page tables, so its cost grows with the
+// resident set; posix_spawnp (CLONE_VM | CLONE_VFORK in glibc) should not.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+static const int resident_mb[] = { 1, 1024 };
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int spawn_fork(char *argv[]) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork() failed");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        perror("exec failed");
+        _exit(1);
+    }
+    waitpid(pid, NULL, 0);
+    return 0;
+}
+
+static int spawn_posix(char *argv[]) {
+    fflush(stdout);
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if (err != 0) {
+        fprintf(stderr, "exec failed: %s\n", strerror(err));
+        return -1;
+    }
+    waitpid(pid, NULL, 0);
+    return 0;
+}
+
+static void bench(const char *method, int (*spawn)(char *[]), char *argv[],
+                  int mb, long count) {
+    double start = now_ns();
+    for (long i = 0; i < count; i++) {
+        if (spawn(argv) != 0) {
+            exit(1);
+        }
+    }
+    printf("%s,%d,%ld,%.1f\n", method, mb, count,
+           (now_ns() - start) / count / 1000);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+    long count = argc > 1 ? atol(argv[1]) : 10000;
+    char *child[] = { argc > 2 ? argv[2] : "/bin/true", NULL };
+
+    printf("method,resident_mb,count,us_per_spawn\n");
+    for (size_t r = 0; r < sizeof(resident_mb) / sizeof(resident_mb[0]); r++) {
+        int mb = resident_mb[r];
+        // Touch every page so it is really resident (and mapped in the
+        // page tables fork has to copy)
+        size_t size = (size_t)mb << 20;
+        char *ballast = malloc(size);
+        if (ballast == NULL) {
+            perror("malloc failed");
+            return 1;
+        }
+        memset(ballast, 1, size);
+
+        bench("fork+exec", spawn_fork, child, mb, count);
+        bench("posix_spawn", spawn_posix, child, mb, count);
+        free(ballast);
+    }
+    return 0;
+}
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include "history.h"
+#include "shellmemory.h"
+
+// One script's burst estimate. The file holds one entry per line:
+//   estimate_ns samples path
+struct HistoryEntry {
+    char *path;
+    uint64_t estimate_ns;
+    int samples;                // 0 = never measured, use the cost model
+};
+
+static struct HistoryEntry *entries = NULL;
+static int entry_count = 0;
+static int entry_capacity = 0;
+static int loaded = 0;
+static int dirty = 0;
+
+// Rough cost of one command, measured on a typical machine. Only the
+// relative order matters: it decides which unseen script runs first.
+struct CommandCost {
+    const char *name;
+    uint64_t ns;
+};
+
+static const struct CommandCost command_costs[] = {
+    { "run", 1000000 },         // fork + exec + wait
+    { "exec", 200000 },         // loads scripts and runs them
+    { "source", 200000 },
+    { "my_ls", 50000 },
+    { "my_mkdir", 20000 },
+    { "my_touch", 20000 },
+    { "my_cd", 5000 },
+    { "echo", 2000 },
+    { "print", 1000 },
+    { "set", 1000 },
+};
+#define DEFAULT_COMMAND_COST 2000
+
+static const char *history_path(char *buf, size_t size) {
+    const char *env = getenv(HISTORY_ENV);
+    if (env != NULL && env[0] != '\0') {
+        return env;
+    }
+    const char *home = getenv("HOME");
+    if (home == NULL) {
+        return NULL;
+    }
+    snprintf(buf, size, "%s/%s", home, HISTORY_FILE);
+    return buf;
+}
+
+static int history_add(const char *path, uint64_t estimate_ns, int samples) {
+    if (entry_count == entry_capacity) {
+        int cap = entry_capacity ? entry_capacity * 2 : 16;
+        struct HistoryEntry *e = realloc(entries, cap * sizeof(*e));
+        if (e == NULL) {
+            return -1;
+        }
+        entries = e;
+        entry_capacity = cap;
+    }
+    char *copy = strdup(path);
+    if (copy == NULL) {
+        return -1;
+    }
+    entries[entry_count].path = copy;
+    entries[entry_count].estimate_ns = estimate_ns;
+    entries[entry_count].samples = samples;
+    return entry_count++;
+}
+
+static void history_load(void) {
+    loaded = 1;
+    char buf[PATH_MAX];
+    const char *file = history_path(buf, sizeof(buf));
+    if (file == NULL) {
+        return;
+    }
+    FILE *f = fopen(file, "r");
+    if (f == NULL) {
+        return;     // no history yet
+    }
+
+    char line[PATH_MAX + 64];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long long estimate;
+        int samples, offset;
+        if (sscanf(line, "%llu %d %n", &estimate, &samples, &offset) != 2) {
+            continue;   // skip malformed lines
+        }
+        char *path = line + offset;
+        path[strcspn(path, "\n")] = '\0';
+        if (path[0] != '\0' && samples > 0) {
+            history_add(path, estimate, samples);
+        }
+    }
+    fclose(f);
+}
+
+int history_lookup(const char *filename) {
+    if (!loaded) {
+        history_load();
+    }
+    char resolved[PATH_MAX];
+    if (realpath(filename, resolved) == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < entry_count; i++) {
+        if (strcmp(entries[i].path, resolved) == 0) {
+            return i;
+        }
+    }
+    return history_add(resolved, 0, 0);
+}
+
+static uint64_t command_cost(const char *cmd) {
+    cmd += strspn(cmd, " \t");
+    size_t len = strcspn(cmd, " \t\r\n");
+    for (size_t i = 0; i < sizeof(command_costs) / sizeof(command_costs[0]); i++) {
+        if (strlen(command_costs[i].name) == len
+            && strncmp(cmd, command_costs[i].name, len) == 0) {
+            return command_costs[i].ns;
+        }
+    }
+    return DEFAULT_COMMAND_COST;
+}
+
+uint64_t history_predict(int id, int start, int length) {
+    if (id >= 0 && entries[id].samples > 0) {
+        return entries[id].estimate_ns;
+    }
+
+    // Cost model: sum over every command, including "a; b" chains
+    uint64_t total = 0;
+    for (int i = start; i < start + length; i++) {
+        const char *line = mem_get_program_line(i);
+        if (line == NULL) {
+            continue;
+        }
+        for (const char *cmd = line; ; ) {
+            total += command_cost(cmd);
+            const char *semi = strchr(cmd, ';');
+            if (semi == NULL) {
+                break;
+            }
+            cmd = semi + 1;
+        }
+    }
+    return total;
+}
+
+void history_record(int id, uint64_t burst_ns) {
+    if (id < 0 || id >= entry_count) {
+        return;
+    }
+    struct HistoryEntry *e = &entries[id];
+    if (e->samples == 0) {
+        e->estimate_ns = burst_ns;
+    } else {
+        e->estimate_ns = (uint64_t)(HISTORY_ALPHA * burst_ns
+                                    + (1 - HISTORY_ALPHA) * e->estimate_ns);
+    }
+    e->samples++;
+    dirty = 1;
+}
+
+void history_save(void) {
+    if (!dirty) {
+        return;
+    }
+    char buf[PATH_MAX];
+    const char *file = history_path(buf, sizeof(buf));
+    if (file == NULL) {
+        return;
+    }
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%d", file, (int)getpid());
+    FILE *f = fopen(tmp, "w");
+    if (f == NULL) {
+        perror("history: fopen failed");
+        return;
+    }
+    for (int i = 0; i < entry_count; i++) {
+        if (entries[i].samples > 0) {
+            fprintf(f, "%llu %d %s\n", (unsigned long long)entries[i].estimate_ns,
+                    entries[i].samples, entries[i].path);
+        }
+    }
+    if (fclose(f) != 0 || rename(tmp, file) != 0) {
+        perror("history: save failed");
+        unlink(tmp);
+        return;
+    }
+    dirty = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+#include <stdint.h>
+
+// Weight of the newest measurement in the exponential average
+#define HISTORY_ALPHA 0.5
+// Environment variable that overrides the history file location
+#define HISTORY_ENV "MYSH_BURST_HISTORY"
+// History file name in $HOME when HISTORY_ENV is not set
+#define HISTORY_FILE ".mysh_burst_history"
+
+/**
+ * Find or create the history entry of a script, keyed by its real path.
+ * The history file is loaded on first use.
+ *
+ * @param filename Script path as given on the command line
+ * @return Entry id, or -1 if the path cannot be resolved
+ */
+int history_lookup(const char *filename);
+
+/**
+ * Predict the CPU burst of a loaded script. Scripts with history use their
+ * exponentially averaged measurements; unseen scripts are estimated with a
+ * per-command cost model over their program lines.
+ *
+ * @param id     Entry id from history_lookup (-1 forces the cost model)
+ * @param start  Index of the script's first program line
+ * @param length Number of program lines
+ * @return Predicted burst in nanoseconds
+ */
+uint64_t history_predict(int id, int start, int length);
+
+/**
+ * Fold a measured burst into a script's estimate:
+ * estimate = ALPHA * measured + (1 - ALPHA) * estimate.
+ *
+ * @param id       Entry id from history_lookup
+ * @param burst_ns Measured running time in nanoseconds
+ */
+void history_record(int id, uint64_t burst_ns);
+
+/**
+ * Write the history file if any estimate changed since it was loaded.
+ * The file is replaced atomically (write to a temporary, then rename).
+ */
+void history_save(void);
+
+#endif // HISTORY_H
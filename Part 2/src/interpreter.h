@@ -1,2 +1,4 @@
 int interpreter(char *command_args[], int args_size);
 int help();
+int prompt_job(char *line);
+void background_wait(void);
@@ -0,0 +1,459 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/inotify.h>
+#include "listing.h"
+
+// Record layout of the getdents64 system call (see getdents64(2))
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// Room left in the buffer before each getdents64 call
+#define LISTING_READ_CHUNK (64 * 1024)
+// Below this many entries a plain qsort beats the radix passes
+#define LISTING_RADIX_MIN 256
+// Size of one batch of output
+#define LISTING_WRITE_CHUNK (64 * 1024)
+
+// The key of a name is one rank byte per character, then the rank of the
+// terminating '\0'. The old my_ls comparator ordered two characters by
+// (tolower(c), c) as signed chars: alphabetic position first (digits sort
+// below letters), then a capital before its lowercase letter at that same
+// position. Those pairs are distinct for all 256 chars, so ranking them
+// once gives a byte order where memcmp on keys matches the comparator.
+// The old comparator also sent a digit before *any* other character,
+// which disagreed with itself when the other one was below '0' (a '.',
+// '-', or the end of a shorter name): its order depended on where qsort
+// happened to compare. Here those characters sort by their code, so
+// "file1" is always listed before "file12".
+static unsigned char char_rank[256];
+static pthread_once_t char_rank_once = PTHREAD_ONCE_INIT;
+
+static int char_order(const void *pa, const void *pb) {
+    int a = *(const int *)pa, b = *(const int *)pb;
+    int lower_a = (signed char)tolower(a), lower_b = (signed char)tolower(b);
+    if (lower_a != lower_b) {
+        return lower_a - lower_b;
+    }
+    return a - b;
+}
+
+static void char_rank_init(void) {
+    int chars[256];
+    for (int i = 0; i < 256; i++) {
+        chars[i] = i - 128;     // every signed char value
+    }
+    qsort(chars, 256, sizeof(int), char_order);
+    for (int r = 0; r < 256; r++) {
+        char_rank[(unsigned char)chars[r]] = r;
+    }
+}
+
+static unsigned char *make_key(unsigned char *key, const char *name, uint32_t len) {
+    for (uint32_t i = 0; i <= len; i++) {
+        *key++ = char_rank[(unsigned char)name[i]];
+    }
+    return key;
+}
+
+static uint64_t key_prefix(const unsigned char *key, uint32_t name_len) {
+    uint32_t key_len = name_len + 1;
+    uint64_t prefix = 0;
+    for (uint32_t i = 0; i < 8; i++) {
+        prefix = (prefix << 8) | (i < key_len ? key[i] : 0);
+    }
+    return prefix;
+}
+
+static int entry_compare(const void *pa, const void *pb) {
+    const struct ListingEntry *a = pa, *b = pb;
+    if (a->prefix != b->prefix) {
+        return a->prefix < b->prefix ? -1 : 1;
+    }
+    // Keys never end early: no key is a prefix of another, so they differ
+    // before the shorter one runs out
+    uint32_t len = (a->name_len < b->name_len ? a->name_len : b->name_len) + 1;
+    return len > 8 ? memcmp(a->key + 8, b->key + 8, len - 8) : 0;
+}
+
+// LSD radix sort on the 8-byte prefixes, then qsort each run of equal
+// prefixes on the rest of the key. Byte positions where every entry
+// agrees are skipped.
+static int sort_entries(struct ListingEntry *entries, int count) {
+    if (count < LISTING_RADIX_MIN) {
+        qsort(entries, count, sizeof(*entries), entry_compare);
+        return 0;
+    }
+    struct ListingEntry *tmp = malloc(count * sizeof(*tmp));
+    if (tmp == NULL) {
+        return -1;
+    }
+    struct ListingEntry *src = entries, *dst = tmp;
+    for (int shift = 0; shift < 64; shift += 8) {
+        int counts[256] = { 0 };
+        for (int i = 0; i < count; i++) {
+            counts[(src[i].prefix >> shift) & 0xff]++;
+        }
+        if (counts[(src[0].prefix >> shift) & 0xff] == count) {
+            continue;
+        }
+        int pos = 0;
+        for (int b = 0; b < 256; b++) {
+            int c = counts[b];
+            counts[b] = pos;
+            pos += c;
+        }
+        for (int i = 0; i < count; i++) {
+            dst[counts[(src[i].prefix >> shift) & 0xff]++] = src[i];
+        }
+        struct ListingEntry *t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != entries) {
+        memcpy(entries, src, count * sizeof(*entries));
+    }
+    free(tmp);
+
+    for (int i = 0; i < count; ) {
+        int j = i + 1;
+        while (j < count && entries[j].prefix == entries[i].prefix) {
+            j++;
+        }
+        if (j - i > 1) {
+            qsort(&entries[i], j - i, sizeof(*entries), entry_compare);
+        }
+        i = j;
+    }
+    return 0;
+}
+
+int listing_read(int dirfd, struct Listing *out) {
+    memset(out, 0, sizeof(*out));
+    pthread_once(&char_rank_once, char_rank_init);
+
+    // Read every record into one buffer
+    size_t used = 0, capacity = 0;
+    char *buf = NULL;
+    while (1) {
+        if (capacity - used < LISTING_READ_CHUNK) {
+            size_t grown = capacity ? capacity * 2 : 4 * LISTING_READ_CHUNK;
+            char *b = realloc(buf, grown);
+            if (b == NULL) {
+                free(buf);
+                errno = ENOMEM;
+                return -1;
+            }
+            buf = b;
+            capacity = grown;
+        }
+        long n = syscall(SYS_getdents64, dirfd, buf + used, capacity - used);
+        if (n < 0) {
+            free(buf);
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        used += n;
+    }
+
+    // Size the entry and key arrays in one pass over the records
+    int count = 0;
+    size_t key_bytes = 0;
+    for (size_t off = 0; off < used; ) {
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+        count++;
+        key_bytes += strlen(d->d_name) + 1;
+        off += d->d_reclen;
+    }
+    struct ListingEntry *entries = malloc((count ? count : 1) * sizeof(*entries));
+    unsigned char *keys = malloc(key_bytes ? key_bytes : 1);
+    if (entries == NULL || keys == NULL) {
+        free(entries);
+        free(keys);
+        free(buf);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    unsigned char *key = keys;
+    int i = 0;
+    for (size_t off = 0; off < used; i++) {
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + off);
+        struct ListingEntry *e = &entries[i];
+        e->name = d->d_name;
+        e->name_len = strlen(d->d_name);
+        e->type = d->d_type;
+        e->key = key;
+        key = make_key(key, e->name, e->name_len);
+        e->prefix = key_prefix(e->key, e->name_len);
+        off += d->d_reclen;
+    }
+    if (sort_entries(entries, count) != 0) {
+        free(entries);
+        free(keys);
+        free(buf);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    out->entries = entries;
+    out->count = count;
+    out->dirents = buf;
+    out->keys = keys;
+    return 0;
+}
+
+void listing_write(const struct Listing *listing, FILE *out) {
+    char chunk[LISTING_WRITE_CHUNK];
+    size_t used = 0;
+    for (int i = 0; i < listing->count; i++) {
+        const struct ListingEntry *e = &listing->entries[i];
+        if (used + e->name_len + 1 > sizeof(chunk)) {
+            fwrite(chunk, 1, used, out);
+            used = 0;
+        }
+        memcpy(chunk + used, e->name, e->name_len);
+        used += e->name_len;
+        chunk[used++] = '\n';
+    }
+    fwrite(chunk, 1, used, out);
+}
+
+void listing_free(struct Listing *listing) {
+    free(listing->entries);
+    free(listing->keys);
+    free(listing->dirents);
+    memset(listing, 0, sizeof(*listing));
+}
+
+// Listing cache: printed listings keyed by directory device/inode, each
+// with an inotify watch on its directory
+struct CachedListing {
+    dev_t dev;
+    ino_t ino;
+    int wd;                     // inotify watch descriptor
+    char *text;                 // Names, one per line, exactly as printed
+    size_t len;
+    uint64_t last_use;
+};
+
+static struct CachedListing cache[LISTING_CACHE_MAX];
+static int cache_count = 0;
+static int inotify_fd = -1;
+static int inotify_failed = 0;
+static uint64_t cache_clock = 0;
+static long cache_hits = 0, cache_misses = 0, cache_invalidations = 0;
+// my_ls runs on MT workers too
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// cache_mutex held
+static void cache_drop(int i) {
+    inotify_rm_watch(inotify_fd, cache[i].wd);
+    free(cache[i].text);
+    cache[i] = cache[--cache_count];
+}
+
+// Drop the entries whose directory changed since the last call.
+// cache_mutex held.
+static void cache_drain_events(void) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; ) {
+            struct inotify_event *ev = (struct inotify_event *)p;
+            for (int i = 0; i < cache_count; i++) {
+                if (cache[i].wd == ev->wd || (ev->mask & IN_Q_OVERFLOW)) {
+                    // dropped one may be replaced by the last: look again
+                    cache_drop(i--);
+                    cache_invalidations++;
+                }
+            }
+            p += sizeof(*ev) + ev->len;
+        }
+    }
+}
+
+static int cache_find(dev_t dev, ino_t ino) {
+    for (int i = 0; i < cache_count; i++) {
+        if (cache[i].dev == dev && cache[i].ino == ino) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Render a listing into one buffer, one name per line
+static char *listing_text(const struct Listing *listing, size_t *len) {
+    size_t size = 0;
+    for (int i = 0; i < listing->count; i++) {
+        size += listing->entries[i].name_len + 1;
+    }
+    char *text = malloc(size ? size : 1);
+    if (text == NULL) {
+        return NULL;
+    }
+    char *p = text;
+    for (int i = 0; i < listing->count; i++) {
+        const struct ListingEntry *e = &listing->entries[i];
+        memcpy(p, e->name, e->name_len);
+        p += e->name_len;
+        *p++ = '\n';
+    }
+    *len = size;
+    return text;
+}
+
+int listing_print_dir(const char *path, FILE *out) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    if (inotify_fd < 0 && !inotify_failed) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        inotify_failed = inotify_fd < 0;
+    }
+    if (inotify_fd >= 0) {
+        cache_drain_events();
+    }
+    int i = cache_find(st.st_dev, st.st_ino);
+    if (i >= 0) {
+        cache_hits++;
+        cache[i].last_use = ++cache_clock;
+        fwrite(cache[i].text, 1, cache[i].len, out);
+        pthread_mutex_unlock(&cache_mutex);
+        return 0;
+    }
+    cache_misses++;
+
+    // Watch before reading, so a change made during the scan is not missed
+    int wd = -1;
+    if (inotify_fd >= 0) {
+        wd = inotify_add_watch(inotify_fd, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM
+                               | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct Listing listing;
+    if (fd < 0 || listing_read(fd, &listing) != 0) {
+        int err = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (wd >= 0) {
+            inotify_rm_watch(inotify_fd, wd);
+        }
+        pthread_mutex_unlock(&cache_mutex);
+        errno = err;
+        return -1;
+    }
+    close(fd);
+
+    size_t len;
+    char *text = listing_text(&listing, &len);
+    if (text == NULL) {
+        // Not cacheable: print it directly
+        listing_write(&listing, out);
+    } else {
+        fwrite(text, 1, len, out);
+    }
+    listing_free(&listing);
+
+    if (text == NULL || wd < 0) {
+        // Without a watch the entry could go stale unnoticed
+        free(text);
+        if (wd >= 0) {
+            inotify_rm_watch(inotify_fd, wd);
+        }
+        pthread_mutex_unlock(&cache_mutex);
+        return 0;
+    }
+    if (cache_count == LISTING_CACHE_MAX) {
+        int lru = 0;
+        for (int j = 1; j < cache_count; j++) {
+            if (cache[j].last_use < cache[lru].last_use) {
+                lru = j;
+            }
+        }
+        cache_drop(lru);
+    }
+    struct CachedListing *c = &cache[cache_count++];
+    c->dev = st.st_dev;
+    c->ino = st.st_ino;
+    c->wd = wd;
+    c->text = text;
+    c->len = len;
+    c->last_use = ++cache_clock;
+    pthread_mutex_unlock(&cache_mutex);
+    return 0;
+}
+
+void listing_cache_invalidate(const char *path) {
+    // The parent directory of path: everything up to the last '/'
+    char dir[PATH_MAX];
+    const char *slash = strrchr(path, '/');
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (slash == path) {
+        strcpy(dir, "/");
+    } else if ((size_t)(slash - path) < sizeof(dir)) {
+        memcpy(dir, path, slash - path);
+        dir[slash - path] = '\0';
+    } else {
+        return;
+    }
+    struct stat st;
+    if (stat(dir, &st) != 0) {
+        return;
+    }
+    pthread_mutex_lock(&cache_mutex);
+    int i = cache_find(st.st_dev, st.st_ino);
+    if (i >= 0) {
+        cache_drop(i);
+        cache_invalidations++;
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void listing_cache_clear(void) {
+    pthread_mutex_lock(&cache_mutex);
+    while (cache_count > 0) {
+        cache_drop(cache_count - 1);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void listing_cache_report(void) {
+    pthread_mutex_lock(&cache_mutex);
+    if (inotify_fd >= 0) {
+        cache_drain_events();
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < cache_count; i++) {
+        bytes += cache[i].len;
+    }
+    long lookups = cache_hits + cache_misses;
+    printf("hits %ld misses %ld (%.1f%% hit rate)\n", cache_hits, cache_misses,
+           lookups ? 100.0 * cache_hits / lookups : 0.0);
+    printf("invalidations %ld\n", cache_invalidations);
+    printf("directories %d of %d, %zu bytes of listings\n", cache_count, LISTING_CACHE_MAX, bytes);
+    if (inotify_failed) {
+        printf("inotify unavailable: listings are not cached\n");
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
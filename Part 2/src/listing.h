@@ -0,0 +1,91 @@
+#ifndef LISTING_H
+#define LISTING_H
+#include <stdio.h>
+#include <stdint.h>
+
+// Most directories whose listing is cached at once (least recently used
+// goes first)
+#define LISTING_CACHE_MAX 32
+
+/**
+ * One directory entry of a listing. name points into the listing's
+ * getdents64 buffer, key into its key buffer. Kept at 32 bytes, so sorting
+ * moves the entries themselves rather than pointers to them.
+ */
+struct ListingEntry {
+    uint64_t prefix;            // First 8 key bytes, big-endian: most compares end here
+    const unsigned char *key;   // Sort key (name_len + 1 bytes), compared with memcmp
+    const char *name;
+    uint32_t name_len;
+    unsigned char type;         // d_type (DT_DIR, DT_REG, ... or DT_UNKNOWN)
+};
+
+/**
+ * A sorted directory listing: every entry (including "." and ".."), in
+ * my_ls order.
+ */
+struct Listing {
+    struct ListingEntry *entries;
+    int count;
+    char *dirents;              // Raw getdents64 records
+    unsigned char *keys;
+};
+
+/**
+ * Read every entry of a directory with getdents64 into one buffer and sort
+ * them in my_ls order: digits first, then letters case-insensitively, a
+ * capital before its lowercase letter at the same position.
+ *
+ * @param dirfd Open directory (read from its current offset)
+ * @param out   Receives the listing; free it with listing_free
+ * @return 0 on success, -1 with errno set on failure
+ */
+int listing_read(int dirfd, struct Listing *out);
+
+/**
+ * Write the names of a listing, one per line, in large batches.
+ *
+ * @param listing Listing from listing_read
+ * @param out     Stream to write to
+ */
+void listing_write(const struct Listing *listing, FILE *out);
+
+/**
+ * Free the buffers of a listing.
+ *
+ * @param listing Listing from listing_read
+ */
+void listing_free(struct Listing *listing);
+
+/**
+ * Print a directory in my_ls order, through the listing cache. The cache
+ * keeps the printed listing per directory (device and inode) and drops it
+ * when inotify reports an entry created, deleted or renamed there, so a
+ * repeated listing of an unchanged directory is a single write.
+ *
+ * @param path Directory to list
+ * @param out  Stream to write to
+ * @return 0 on success, -1 with errno set on failure
+ */
+int listing_print_dir(const char *path, FILE *out);
+
+/**
+ * Drop the cached listing of the directory that contains path. The shell
+ * calls this after creating path itself, without waiting for inotify.
+ *
+ * @param path File or directory just created
+ */
+void listing_cache_invalidate(const char *path);
+
+/**
+ * Drop every cached listing.
+ */
+void listing_cache_clear(void);
+
+/**
+ * Print cache hits, misses, invalidations, cached directories and memory
+ * held by the cache.
+ */
+void listing_cache_report(void);
+
+#endif // LISTING_H
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mysc.h"
+
+static const char *const opcode_names[OP_COUNT] = {
+    [OP_UNKNOWN] = "(other)", [OP_EMPTY] = "(empty)",
+    [OP_HELP] = "help", [OP_QUIT] = "quit", [OP_SET] = "set",
+    [OP_PRINT] = "print", [OP_ECHO] = "echo", [OP_MY_LS] = "my_ls",
+    [OP_MY_MKDIR] = "my_mkdir", [OP_MY_TOUCH] = "my_touch", [OP_MY_CD] = "my_cd",
+    [OP_MY_FIND] = "my_find", [OP_SOURCE] = "source", [OP_EXEC] = "exec",
+    [OP_RUN] = "run", [OP_STATS] = "stats", [OP_TRACE] = "trace",
+    [OP_JOBS] = "jobs", [OP_WAIT] = "wait", [OP_KILL] = "kill",
+    [OP_NICE] = "nice", [OP_SLEEP] = "sleep", [OP_HASH] = "hash",
+    [OP_LSCACHE] = "lscache", [OP_COMPILE] = "compile", [OP_PROFILE] = "profile",
+    [OP_MEMINFO] = "meminfo",
+};
+
+// Growable byte buffer for building an image
+struct Buffer {
+    char *data;
+    size_t len, capacity;
+};
+
+static int buffer_add(struct Buffer *b, const void *data, size_t len) {
+    if (b->len + len > b->capacity) {
+        size_t capacity = b->capacity ? b->capacity : 4096;
+        while (capacity < b->len + len) {
+            capacity *= 2;
+        }
+        char *grown = realloc(b->data, capacity);
+        if (grown == NULL) {
+            return -1;
+        }
+        b->data = grown;
+        b->capacity = capacity;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+// Add a NUL-terminated string to the pool; returns its offset
+static int pool_add(struct Buffer *pool, const char *s, size_t len, uint32_t *offset) {
+    *offset = pool->len;
+    char nul = '\0';
+    if (buffer_add(pool, s, len) != 0 || buffer_add(pool, &nul, 1) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t fnv1a(uint64_t h, const void *data, size_t len) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+int mysc_opcode(const char *word, size_t len) {
+    if (len == 0) {
+        return OP_EMPTY;
+    }
+    for (int op = OP_HELP; op < OP_COUNT; op++) {
+        if (strlen(opcode_names[op]) == len && strncmp(word, opcode_names[op], len) == 0) {
+            return op;
+        }
+    }
+    return OP_UNKNOWN;
+}
+
+const char *mysc_opcode_name(int op) {
+    return op >= 0 && op < OP_COUNT ? opcode_names[op] : opcode_names[OP_UNKNOWN];
+}
+
+int mysc_is_image(const char *filename) {
+    size_t len = strlen(filename), suffix = strlen(MYSC_SUFFIX);
+    return len > suffix && strcmp(filename + len - suffix, MYSC_SUFFIX) == 0;
+}
+
+// Split a line into words the way parseInput does: at white space and
+// ';'. Each ';' is kept as a word of its own, so chains survive.
+static int compile_line(const char *line, struct Buffer *instructions, struct Buffer *args,
+                        struct Buffer *pool) {
+    struct MyscInstruction ins;
+    ins.first_arg = args->len / sizeof(uint32_t);
+    ins.argc = 0;
+    if (pool_add(pool, line, strlen(line), &ins.line) != 0) {
+        return -1;
+    }
+    const char *first = NULL;
+    size_t first_len = 0;
+    for (const char *p = line; *p != '\0'; ) {
+        if (isspace((unsigned char)*p)) {
+            p++;
+            continue;
+        }
+        size_t len = *p == ';' ? 1 : strcspn(p, " \t\r\n\v\f;");
+        uint32_t offset;
+        if (pool_add(pool, p, len, &offset) != 0 || buffer_add(args, &offset, sizeof(offset)) != 0) {
+            return -1;
+        }
+        if (first == NULL) {
+            first = p;
+            first_len = len;
+        }
+        ins.argc++;
+        p += len;
+    }
+    ins.opcode = mysc_opcode(first ? first : "", first_len);
+    return buffer_add(instructions, &ins, sizeof(ins));
+}
+
+int mysc_compile(const char *script, const char *out) {
+    FILE *in = fopen(script, "rt");
+    if (in == NULL) {
+        return -1;
+    }
+    struct Buffer instructions = { 0 }, args = { 0 }, pool = { 0 };
+    char line[101];     // same limit as mem_segment_load
+    int count = 0, failed = 0;
+    while (!failed && fgets(line, sizeof(line), in) != NULL) {
+        int len = strlen(line);
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (len > 0 && line[len - 1] == '\r') {
+            line[--len] = '\0';
+        }
+        failed = compile_line(line, &instructions, &args, &pool) != 0;
+        count++;
+    }
+    fclose(in);
+
+    struct MyscHeader header;
+    memcpy(header.magic, MYSC_MAGIC, sizeof(header.magic));
+    header.version = MYSC_VERSION;
+    header.count = count;
+    header.arg_count = args.len / sizeof(uint32_t);
+    header.pool_size = pool.len;
+    header.reserved = 0;
+    header.checksum = fnv1a(1469598103934665603ULL, instructions.data, instructions.len);
+    header.checksum = fnv1a(header.checksum, args.data, args.len);
+    header.checksum = fnv1a(header.checksum, pool.data, pool.len);
+
+    char tmp[PATH_MAX + 16];
+    snprintf(tmp, sizeof(tmp), "%s.%d", out, (int)getpid());
+    FILE *f = failed ? NULL : fopen(tmp, "wb");
+    if (f != NULL) {
+        fwrite(&header, sizeof(header), 1, f);
+        fwrite(instructions.data, 1, instructions.len, f);
+        fwrite(args.data, 1, args.len, f);
+        fwrite(pool.data, 1, pool.len, f);
+        if (fclose(f) != 0 || rename(tmp, out) != 0) {
+            unlink(tmp);
+            failed = 1;
+        }
+    } else {
+        failed = 1;
+    }
+    int err = errno;
+    free(instructions.data);
+    free(args.data);
+    free(pool.data);
+    if (failed) {
+        errno = err;
+        return -1;
+    }
+    return count;
+}
+
+static int image_valid(const struct MyscImage *image) {
+    const struct MyscHeader *h = image->header;
+    if (memcmp(h->magic, MYSC_MAGIC, sizeof(h->magic)) != 0 || h->version != MYSC_VERSION) {
+        return 0;
+    }
+    uint64_t expected = sizeof(*h) + (uint64_t)h->count * sizeof(struct MyscInstruction)
+        + (uint64_t)h->arg_count * sizeof(uint32_t) + h->pool_size;
+    if (expected != image->size) {
+        return 0;   // truncated, or padded
+    }
+    // An empty script compiles to an image with no lines and no pool
+    if (h->pool_size == 0 ? h->count != 0 : image->pool[h->pool_size - 1] != '\0') {
+        return 0;
+    }
+    const char *body = (const char *)image->base + sizeof(*h);
+    if (fnv1a(1469598103934665603ULL, body, image->size - sizeof(*h)) != h->checksum) {
+        return 0;
+    }
+    // The checksum matches, but a hand-made image could still point outside
+    // the pool
+    for (uint32_t i = 0; i < h->count; i++) {
+        const struct MyscInstruction *ins = &image->instructions[i];
+        if (ins->opcode >= OP_COUNT || ins->line >= h->pool_size
+            || (uint64_t)ins->first_arg + ins->argc > h->arg_count) {
+            return 0;
+        }
+    }
+    for (uint32_t i = 0; i < h->arg_count; i++) {
+        if (image->args[i] >= h->pool_size) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int mysc_map(const char *filename, struct MyscImage *image) {
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct MyscHeader)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    image->base = base;
+    image->size = st.st_size;
+    image->header = base;
+    image->instructions = (const struct MyscInstruction *)(image->header + 1);
+    image->args = (const uint32_t *)(image->instructions + image->header->count);
+    image->pool = (const char *)(image->args + image->header->arg_count);
+    // Check the sizes before image_valid follows args and pool
+    if (image->header->count > st.st_size || image->header->arg_count > st.st_size
+        || !image_valid(image)) {
+        munmap(base, st.st_size);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+const char *mysc_line(const struct MyscImage *image, uint32_t index) {
+    return image->pool + image->instructions[index].line;
+}
+
+void mysc_unmap(void *base, size_t size) {
+    munmap(base, size);
+}
@@ -0,0 +1,122 @@
+#ifndef MYSC_H
+#define MYSC_H
+#include <stddef.h>
+#include <stdint.h>
+
+// Compiled script image (.mysc). All integers are native-endian; the
+// layout is:
+//   struct MyscHeader
+//   struct MyscInstruction[count]   one per script line
+//   uint32_t args[arg_count]        string pool offsets of each line's words
+//   char pool[pool_size]            NUL-terminated strings
+// checksum is 64-bit FNV-1a over everything after the header. An empty
+// script gives an image with no instructions and an empty pool.
+//
+// Only the lines are used to run an image: source and exec map it and
+// hand each line to the parser as if it had been read from the script.
+// The opcode and word tables record how the compiler split each line;
+// loading checks their offsets, but nothing dispatches from them.
+#define MYSC_MAGIC "MYSC"
+#define MYSC_VERSION 1
+#define MYSC_SUFFIX ".mysc"
+
+/**
+ * Instruction opcodes: the built-in a line starts with.
+ */
+typedef enum {
+    OP_UNKNOWN,                 // Not a built-in (reports Unknown Command when run)
+    OP_EMPTY,                   // Blank line
+    OP_HELP, OP_QUIT, OP_SET, OP_PRINT, OP_ECHO,
+    OP_MY_LS, OP_MY_MKDIR, OP_MY_TOUCH, OP_MY_CD, OP_MY_FIND,
+    OP_SOURCE, OP_EXEC, OP_RUN, OP_STATS, OP_TRACE,
+    OP_JOBS, OP_WAIT, OP_KILL, OP_NICE, OP_SLEEP,
+    OP_HASH, OP_LSCACHE, OP_COMPILE, OP_PROFILE, OP_MEMINFO,
+    OP_COUNT
+} MyscOpcode;
+
+struct MyscHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;             // Instructions
+    uint32_t arg_count;         // Entries in the args table
+    uint32_t pool_size;         // Bytes of string pool
+    uint32_t reserved;
+    uint64_t checksum;
+};
+
+struct MyscInstruction {
+    uint16_t opcode;            // MyscOpcode
+    uint16_t argc;              // Words, including ";" separators of a chain
+    uint32_t line;              // Pool offset of the whole line, as source would load it
+    uint32_t first_arg;         // Index of the first word in the args table
+};
+
+/**
+ * A validated image mapped read-only into memory.
+ */
+struct MyscImage {
+    void *base;
+    size_t size;
+    const struct MyscHeader *header;
+    const struct MyscInstruction *instructions;
+    const uint32_t *args;
+    const char *pool;
+};
+
+/**
+ * @param word Command word (need not be NUL-terminated)
+ * @param len  Length of word
+ * @return Its MyscOpcode: OP_EMPTY if len is 0, OP_UNKNOWN if not a built-in
+ */
+int mysc_opcode(const char *word, size_t len);
+
+/**
+ * @param op MyscOpcode
+ * @return The built-in's name, or "(other)" / "(empty)"
+ */
+const char *mysc_opcode_name(int op);
+
+/**
+ * @param filename Path of a script
+ * @return Non-zero if its name ends in .mysc
+ */
+int mysc_is_image(const char *filename);
+
+/**
+ * Compile a text script into a .mysc image. Lines are read exactly as
+ * mem_segment_load reads them, so running the image and the text gives
+ * the same program. The image is written to a temporary file and renamed
+ * into place.
+ *
+ * @param script Text script
+ * @param out    Image to write
+ * @return Number of instructions written, or -1 with errno set
+ */
+int mysc_compile(const char *script, const char *out);
+
+/**
+ * Map an image read-only and check its header, size, checksum and offsets.
+ * A truncated or corrupted file is rejected.
+ *
+ * @param filename Image to map
+ * @param image    Receives the mapping; release it with mysc_unmap
+ * @return 0 on success, -1 on failure
+ */
+int mysc_map(const char *filename, struct MyscImage *image);
+
+/**
+ * @param image Image from mysc_map
+ * @param index Instruction index
+ * @return The instruction's line, pointing into the mapping
+ */
+const char *mysc_line(const struct MyscImage *image, uint32_t index);
+
+/**
+ * Unmap an image.
+ *
+ * @param base Mapping base (MyscImage.base)
+ * @param size Mapping size (MyscImage.size)
+ */
+void mysc_unmap(void *base, size_t size);
+
+#endif // MYSC_H
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "pathcache.h"
+
+// Command name -> resolved path. Open addressing with linear probing;
+// empty slots have name == NULL.
+struct PathEntry {
+    char *name;
+    char *path;
+    int hits;
+};
+
+static struct PathEntry *table = NULL;
+static int table_size = 0;
+static int table_count = 0;
+// PATH the cached entries were resolved against
+static char *cached_path_env = NULL;
+// run is called from the MT workers too
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned name_slot(const char *name) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+        h = (h ^ *p) * 16777619u;
+    }
+    return h & (table_size - 1);
+}
+
+static struct PathEntry *entry_find(const char *name) {
+    if (table_size == 0) {
+        return NULL;
+    }
+    for (unsigned i = name_slot(name); table[i].name != NULL; i = (i + 1) & (table_size - 1)) {
+        if (strcmp(table[i].name, name) == 0) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+static void entry_place(struct PathEntry e) {
+    unsigned i = name_slot(e.name);
+    while (table[i].name != NULL) {
+        i = (i + 1) & (table_size - 1);
+    }
+    table[i] = e;
+}
+
+static int table_grow(void) {
+    int old_size = table_size;
+    struct PathEntry *old = table;
+    int size = table_size ? table_size * 2 : 32;
+    struct PathEntry *grown = calloc(size, sizeof(*grown));
+    if (grown == NULL) {
+        return -1;
+    }
+    table = grown;
+    table_size = size;
+    for (int i = 0; i < old_size; i++) {
+        if (old[i].name != NULL) {
+            entry_place(old[i]);
+        }
+    }
+    free(old);
+    return 0;
+}
+
+static void entry_insert(const char *name, const char *path) {
+    if (2 * (table_count + 1) > table_size && table_grow() != 0) {
+        return;     // just don't cache
+    }
+    struct PathEntry e = { strdup(name), strdup(path), 1 };
+    if (e.name == NULL || e.path == NULL) {
+        free(e.name);
+        free(e.path);
+        return;
+    }
+    entry_place(e);
+    table_count++;
+}
+
+// cache_mutex held
+static void clear_locked(void) {
+    for (int i = 0; i < table_size; i++) {
+        free(table[i].name);
+        free(table[i].path);
+        table[i].name = NULL;
+        table[i].path = NULL;
+    }
+    table_count = 0;
+}
+
+static int is_executable(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode) && access(path, X_OK) == 0;
+}
+
+// Walk the search path like execvp. Sets *cacheable to 0 when the match came
+// from a relative entry ("" or "bin"), which depends on the working directory.
+static int search_path(const char *name, const char *search, char *buf, size_t size,
+                       int *cacheable) {
+    size_t name_len = strlen(name);
+    for (const char *dir = search; ; ) {
+        size_t dir_len = strcspn(dir, ":");
+        if (dir_len == 0) {
+            // empty entry means the current directory
+            if (name_len + 1 <= size) {
+                memcpy(buf, name, name_len + 1);
+                if (is_executable(buf)) {
+                    *cacheable = 0;
+                    return 0;
+                }
+            }
+        } else if (dir_len + 1 + name_len + 1 <= size) {
+            memcpy(buf, dir, dir_len);
+            buf[dir_len] = '/';
+            memcpy(buf + dir_len + 1, name, name_len + 1);
+            if (is_executable(buf)) {
+                *cacheable = dir[0] == '/';
+                return 0;
+            }
+        }
+        if (dir[dir_len] == '\0') {
+            return -1;
+        }
+        dir += dir_len + 1;
+    }
+}
+
+int path_cache_resolve(const char *name, char *buf, size_t size) {
+    if (strchr(name, '/') != NULL) {
+        if (strlen(name) >= size) {
+            return -1;
+        }
+        strcpy(buf, name);
+        return 0;
+    }
+
+    const char *search = getenv("PATH");
+    if (search == NULL) {
+        search = PATH_CACHE_DEFAULT_PATH;
+    }
+
+    pthread_mutex_lock(&cache_mutex);
+    if (cached_path_env == NULL || strcmp(cached_path_env, search) != 0) {
+        // PATH changed: every cached entry may now resolve differently
+        clear_locked();
+        free(cached_path_env);
+        cached_path_env = strdup(search);
+    }
+    struct PathEntry *e = entry_find(name);
+    if (e != NULL && strlen(e->path) < size) {
+        e->hits++;
+        strcpy(buf, e->path);
+        pthread_mutex_unlock(&cache_mutex);
+        return 0;
+    }
+
+    int cacheable = 1;
+    int found = search_path(name, search, buf, size, &cacheable);
+    if (found == 0 && cacheable && cached_path_env != NULL) {
+        entry_insert(name, buf);
+    }
+    pthread_mutex_unlock(&cache_mutex);
+    return found;
+}
+
+void path_cache_forget(const char *name) {
+    pthread_mutex_lock(&cache_mutex);
+    struct PathEntry *e = entry_find(name);
+    if (e == NULL) {
+        pthread_mutex_unlock(&cache_mutex);
+        return;
+    }
+    free(e->name);
+    free(e->path);
+    e->name = NULL;
+    e->path = NULL;
+    table_count--;
+    // Backward-shift deletion, as in the scheduler's pid index
+    unsigned mask = table_size - 1;
+    unsigned hole = e - table;
+    for (unsigned j = (hole + 1) & mask; table[j].name != NULL; j = (j + 1) & mask) {
+        unsigned home = name_slot(table[j].name);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            table[hole] = table[j];
+            table[j].name = NULL;
+            table[j].path = NULL;
+            hole = j;
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void path_cache_clear(void) {
+    pthread_mutex_lock(&cache_mutex);
+    clear_locked();
+    pthread_mutex_unlock(&cache_mutex);
+}
+
+void path_cache_print(void) {
+    pthread_mutex_lock(&cache_mutex);
+    if (table_count == 0) {
+        printf("hash: hash table empty\n");
+    } else {
+        printf("hits\tcommand\n");
+        for (int i = 0; i < table_size; i++) {
+            if (table[i].name != NULL) {
+                printf("%4d\t%s\n", table[i].hits, table[i].path);
+            }
+        }
+    }
+    pthread_mutex_unlock(&cache_mutex);
+}
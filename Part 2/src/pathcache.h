@@ -0,0 +1,37 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+#include <stddef.h>
+
+// Search path used when PATH is unset (same as execvp)
+#define PATH_CACHE_DEFAULT_PATH "/bin:/usr/bin"
+
+/**
+ * Resolve a command name to the executable run would exec, like execvp's
+ * PATH search. Results are cached by name; the whole cache is dropped when
+ * PATH changes. Names containing '/' are returned unchanged and never cached.
+ *
+ * @param name Command name (args[0] of run)
+ * @param buf  Receives the resolved path
+ * @param size Size of buf
+ * @return 0 on success, -1 if no executable was found on PATH
+ */
+int path_cache_resolve(const char *name, char *buf, size_t size);
+
+/**
+ * Drop one cached name, e.g. after its cached path failed to exec.
+ *
+ * @param name Command name
+ */
+void path_cache_forget(const char *name);
+
+/**
+ * Drop every cached name (hash -r).
+ */
+void path_cache_clear(void);
+
+/**
+ * Print the cached names with their hit counts and paths (hash).
+ */
+void path_cache_print(void);
+
+#endif // PATHCACHE_H
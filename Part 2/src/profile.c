@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "profile.h"
+#include "mysc.h"
+
+#define SUB_BUCKETS (1 << PROFILE_SUB_BITS)
+// Values below SUB_BUCKETS get a bucket each; every power of two above
+// that gets SUB_BUCKETS
+#define BUCKETS ((64 - PROFILE_SUB_BITS + 1) * SUB_BUCKETS)
+
+// HDR-style log-linear histogram of one command in one context
+struct ProfileCell {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint32_t buckets[BUCKETS];
+};
+
+int profile_enabled = 0;
+
+// Allocated on first use: most command/context pairs never occur
+static struct ProfileCell *cells[PROFILE_CONTEXTS][OP_COUNT];
+static pthread_mutex_t profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int bucket_of(uint64_t ns) {
+    if (ns < SUB_BUCKETS) {
+        return ns;
+    }
+    int e = 63 - __builtin_clzll(ns);
+    return (e - PROFILE_SUB_BITS + 1) * SUB_BUCKETS
+        + ((ns >> (e - PROFILE_SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+// Highest time that falls in a bucket
+static uint64_t bucket_value(int b) {
+    if (b < SUB_BUCKETS) {
+        return b;
+    }
+    int shift = b / SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(SUB_BUCKETS + b % SUB_BUCKETS) << shift;
+    return low + ((uint64_t)1 << shift) - 1;
+}
+
+void profile_set(int on) {
+    __atomic_store_n(&profile_enabled, on, __ATOMIC_RELAXED);
+}
+
+void profile_record(int op, int context, uint64_t ns) {
+    if (op < 0 || op >= OP_COUNT || context < 0 || context >= PROFILE_CONTEXTS) {
+        return;
+    }
+    pthread_mutex_lock(&profile_mutex);
+    struct ProfileCell *cell = cells[context][op];
+    if (cell == NULL) {
+        cell = cells[context][op] = calloc(1, sizeof(struct ProfileCell));
+    }
+    if (cell != NULL) {
+        cell->count++;
+        cell->total_ns += ns;
+        if (ns > cell->max_ns) {
+            cell->max_ns = ns;
+        }
+        cell->buckets[bucket_of(ns)]++;
+    }
+    pthread_mutex_unlock(&profile_mutex);
+}
+
+void profile_clear(void) {
+    pthread_mutex_lock(&profile_mutex);
+    for (int c = 0; c < PROFILE_CONTEXTS; c++) {
+        for (int op = 0; op < OP_COUNT; op++) {
+            free(cells[c][op]);
+            cells[c][op] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&profile_mutex);
+}
+
+// Time below which a fraction q of the recorded times fall
+static uint64_t cell_percentile(const struct ProfileCell *cell, double q) {
+    uint64_t rank = (uint64_t)(q * cell->count + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    uint64_t seen = 0;
+    for (int b = 0; b < BUCKETS; b++) {
+        seen += cell->buckets[b];
+        if (seen >= rank) {
+            uint64_t v = bucket_value(b);
+            return v < cell->max_ns ? v : cell->max_ns;
+        }
+    }
+    return cell->max_ns;
+}
+
+static const char *context_name(int context, char *buf, size_t size) {
+    if (context == PROFILE_INTERACTIVE) {
+        return "interactive";
+    }
+    if (context == PROFILE_SOURCE) {
+        return "source";
+    }
+    snprintf(buf, size, "exec %s", scheduler_policy_name(context - PROFILE_SCHEDULED));
+    return buf;
+}
+
+void profile_report(void) {
+    pthread_mutex_lock(&profile_mutex);
+    int printed = 0;
+    for (int c = 0; c < PROFILE_CONTEXTS; c++) {
+        // Busiest command first
+        int order[OP_COUNT], n = 0;
+        for (int op = 0; op < OP_COUNT; op++) {
+            if (cells[c][op] == NULL) {
+                continue;
+            }
+            int i = n++;
+            while (i > 0 && cells[c][order[i - 1]]->total_ns < cells[c][op]->total_ns) {
+                order[i] = order[i - 1];
+                i--;
+            }
+            order[i] = op;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (printed++ == 0) {
+            printf("%-14s %-10s %8s %10s %10s %10s %12s\n",
+                   "CONTEXT", "COMMAND", "COUNT", "P50_US", "P99_US", "MAX_US", "TOTAL_MS");
+        }
+        char buf[32];
+        const char *name = context_name(c, buf, sizeof(buf));
+        for (int i = 0; i < n; i++) {
+            const struct ProfileCell *cell = cells[c][order[i]];
+            printf("%-14s %-10s %8llu %10.1f %10.1f %10.1f %12.3f\n",
+                   name, mysc_opcode_name(order[i]), (unsigned long long)cell->count,
+                   cell_percentile(cell, 0.50) / 1e3, cell_percentile(cell, 0.99) / 1e3,
+                   cell->max_ns / 1e3, cell->total_ns / 1e6);
+        }
+    }
+    if (printed == 0) {
+        printf("profile: no commands recorded\n");
+    }
+    pthread_mutex_unlock(&profile_mutex);
+}
@@ -0,0 +1,49 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+#include <stdint.h>
+#include "scheduler.h"
+
+// Contexts a command can run in. Scheduled commands are split by the
+// policy of their job: PROFILE_SCHEDULED + policy.
+#define PROFILE_INTERACTIVE 0   // Typed at the prompt (or read from a batch file)
+#define PROFILE_SOURCE 1        // A line of a sourced script
+#define PROFILE_SCHEDULED 2
+#define PROFILE_CONTEXTS (PROFILE_SCHEDULED + POLICY_SJF_EST + 1)
+
+// Histogram resolution: each power of two is split into 2^PROFILE_SUB_BITS
+// buckets, so a recorded time is within 1/16 (~6%) of its bucket's value
+#define PROFILE_SUB_BITS 4
+
+// Non-zero while the profiler is on. Read and written only through relaxed
+// __atomic builtins: interpreter() checks it on every thread without a lock.
+extern int profile_enabled;
+
+/**
+ * Turn profiling on or off. Recorded times are kept until profile_clear().
+ *
+ * @param on Non-zero to enable
+ */
+void profile_set(int on);
+
+/**
+ * Add one command's time to the histogram of its command and context.
+ *
+ * @param op      MyscOpcode of the command word (OP_UNKNOWN for anything else)
+ * @param context PROFILE_INTERACTIVE, PROFILE_SOURCE or PROFILE_SCHEDULED + policy
+ * @param ns      Wall time of the command, nanoseconds (including any
+ *                commands it ran, e.g. the lines of a sourced script)
+ */
+void profile_record(int op, int context, uint64_t ns);
+
+/**
+ * Forget everything recorded so far.
+ */
+void profile_clear(void);
+
+/**
+ * Print count, p50, p99, max and total time per command, grouped by
+ * context, busiest command first.
+ */
+void profile_report(void);
+
+#endif // PROFILE_H
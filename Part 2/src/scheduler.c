@@ -1,12 +1,81 @@
 #include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 #include "scheduler.h"
 #include "shellmemory.h"
+#include "stats.h"
+#include "trace.h"
+#include "alloc.h"
 #include <pthread.h>
 
 // Global ready queue for FCFS scheduling
 static struct ReadyQueue ready_queue;
 // Auto-incrementing PID counter
 static int next_pid = 1;
+// Instructions executed by all PCBs (updated atomically: MT workers)
+static uint64_t instruction_clock = 0;
+
+// Min-heap of PCBs ordered by (heap_key, heap_seq), used by STRIDE and EDF
+static struct PCB **ready_heap = NULL;
+static int heap_count = 0;
+static int heap_capacity = 0;
+static uint64_t heap_next_seq = 0;
+// Pass value of the last job STRIDE picked; new jobs start one stride later
+static uint64_t stride_global_pass = 0;
+// LOTTERY random state (xorshift32), reset for every top-level exec
+#define LOTTERY_SEED 2463534242u
+static uint32_t lottery_state = LOTTERY_SEED;
+
+// Red-black tree of PCBs ordered by (vruntime, pid), used by FAIR.
+// fair_nil is the shared black leaf; a PCB is in the tree iff rb_parent != NULL.
+static struct PCB fair_nil;
+#define FAIR_NIL (&fair_nil)
+static struct PCB *fair_root = FAIR_NIL;
+static struct PCB *fair_leftmost = NULL;    // Cached minimum, the next job to run
+static int fair_count = 0;
+static long fair_total_weight = 0;
+// Largest vruntime picked so far; arriving jobs start here
+static uint64_t fair_min_vruntime = 0;
+
+// Every PCB between pcb_create and pcb_free, so reports can see jobs
+// that are running or queued in any structure
+static struct PCB **live_pcbs = NULL;
+static int live_count = 0;
+static int live_capacity = 0;
+static pthread_mutex_t live_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Broadcast whenever a live PCB is freed (pcb_wait_exit)
+static pthread_cond_t live_exit = PTHREAD_COND_INITIALIZER;
+// pid -> PCB hash index over the live table: open addressing with linear
+// probing, power-of-2 size kept at least twice live_count
+static struct PCB **pid_index = NULL;
+static int pid_index_size = 0;
+// Freed PCBs kept for reuse, linked through next (live_mutex): a schedule
+// reuses the PCBs of the last one instead of going back to malloc
+#define PCB_CACHE_MAX 64
+static struct PCB *pcb_cache = NULL;
+static int pcb_cache_count = 0;
+
+// Timing wheel of BLOCKED PCBs: bucket tick % TIMER_SLOTS holds the PCBs
+// waking at that tick (or TIMER_SLOTS, 2 * TIMER_SLOTS... ticks later),
+// linked through next
+static struct PCB *timer_slots[TIMER_SLOTS];
+static int timer_count = 0;
+static uint64_t timer_last_tick = 0;            // Last tick already expired
+static uint64_t timer_next = UINT64_MAX;        // Earliest wake, tick-aligned ns
+
+// PCBs blocked on a run child: one pidfd per child in child_epoll, with
+// the PCB as the event data. A pidfd becomes readable when the child exits.
+// child_wakefd, an eventfd with NULL event data, is in the set too, so a
+// thread blocked in epoll_wait can be woken when new work arrives.
+static int child_epoll = -1;
+static int child_wakefd = -1;
+static int child_count = 0;
 
 // MT synchronization
 static pthread_mutex_t rq_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -14,6 +83,8 @@ static pthread_cond_t rq_not_empty = PTHREAD_COND_INITIALIZER;
 static pthread_cond_t rq_all_done = PTHREAD_COND_INITIALIZER;
 
 static int rq_shutdown = 0;
+// An MT worker is blocked in child_wait_block (at most one at a time)
+static int rq_polling = 0;
 // Number of workers currently holding a PCB (running a time slice)
 static int rq_active_workers = 0;
 
@@ -26,6 +97,7 @@ void ready_queue_enqueue(struct PCB *pcb) {
     if (pcb == NULL) {
         return;
     }
+    TRACE(TRACE_ENQUEUE, pcb->pid, 0);
 
     // Clear next pointer since this will be last element
     pcb->next = NULL;
@@ -58,35 +130,257 @@ struct PCB *ready_queue_dequeue(void) {
 
     // Clear next pointer before returning
     pcb->next = NULL;
+    TRACE(TRACE_DEQUEUE, pcb->pid, 0);
     return pcb;
 }
 
 int ready_queue_is_empty(void) {
-    return ready_queue.head == NULL;
+    return ready_queue.head == NULL && heap_count == 0 && fair_count == 0;
+}
+
+static unsigned pid_slot(int pid) {
+    // Fibonacci hashing spreads consecutive pids across the table
+    return ((unsigned)pid * 2654435769u) & (pid_index_size - 1);
+}
+
+static void pid_index_insert(struct PCB *pcb) {
+    unsigned i = pid_slot(pcb->pid);
+    while (pid_index[i] != NULL) {
+        i = (i + 1) & (pid_index_size - 1);
+    }
+    pid_index[i] = pcb;
+}
+
+// Rebuild the index from the live table at twice the size. live_mutex held.
+static int pid_index_grow(void) {
+    int size = pid_index_size ? pid_index_size * 2 : 32;
+    struct PCB **grown = alloc_calloc(ALLOC_SCHEDULER, size, sizeof(*grown));
+    if (grown == NULL) {
+        return -1;
+    }
+    alloc_free(ALLOC_SCHEDULER, pid_index);
+    pid_index = grown;
+    pid_index_size = size;
+    for (int i = 0; i < live_count; i++) {
+        pid_index_insert(live_pcbs[i]);
+    }
+    return 0;
+}
+
+static void pid_index_remove(int pid) {
+    unsigned mask = pid_index_size - 1;
+    unsigned i = pid_slot(pid);
+    while (pid_index[i] != NULL && pid_index[i]->pid != pid) {
+        i = (i + 1) & mask;
+    }
+    if (pid_index[i] == NULL) {
+        return;
+    }
+    // Backward-shift deletion: pull later entries of the probe run into
+    // the hole so that lookups never need tombstones
+    unsigned hole = i;
+    for (unsigned j = (i + 1) & mask; pid_index[j] != NULL; j = (j + 1) & mask) {
+        unsigned home = pid_slot(pid_index[j]->pid);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            pid_index[hole] = pid_index[j];
+            hole = j;
+        }
+    }
+    pid_index[hole] = NULL;
+}
+
+static struct PCB *pid_index_lookup(int pid) {
+    if (pid_index_size == 0) {
+        return NULL;
+    }
+    for (unsigned i = pid_slot(pid); pid_index[i] != NULL; i = (i + 1) & (pid_index_size - 1)) {
+        if (pid_index[i]->pid == pid) {
+            return pid_index[i];
+        }
+    }
+    return NULL;
+}
+
+struct PCB *pcb_find(int pid) {
+    pthread_mutex_lock(&live_mutex);
+    struct PCB *pcb = pid_index_lookup(pid);
+    pthread_mutex_unlock(&live_mutex);
+    return pcb;
+}
+
+int pcb_kill(int pid) {
+    pthread_mutex_lock(&live_mutex);
+    struct PCB *pcb = pid_index_lookup(pid);
+    if (pcb == NULL) {
+        pthread_mutex_unlock(&live_mutex);
+        return -1;
+    }
+    // The PCB cannot be freed while live_mutex is held; once it is out of
+    // the ready structures nobody else can reach it either
+    if (pcb->state == PCB_RUNNING || ready_queue_remove(pcb) != 0) {
+        // Mid-slice (possibly the caller itself): finish it at the next
+        // instruction boundary; its lines go with the PCB
+        mem_segment_close(pcb->segment);
+        pcb->pc = pcb->length;
+        pcb = NULL;
+    }
+    pthread_mutex_unlock(&live_mutex);
+    pcb_free(pcb);
+    return 0;
+}
+
+int pcb_renice(int pid, int delta) {
+    pthread_mutex_lock(&live_mutex);
+    struct PCB *pcb = pid_index_lookup(pid);
+    int ret = -1;
+    if (pcb != NULL) {
+        pthread_mutex_lock(&rq_mutex);
+        ret = ready_queue_renice(pcb, delta) == 0 ? 0 : -2;
+        pthread_mutex_unlock(&rq_mutex);
+    }
+    pthread_mutex_unlock(&live_mutex);
+    return ret;
+}
+
+void pcb_wait_exit(int pid) {
+    pthread_mutex_lock(&live_mutex);
+    while (pid == 0 ? live_count > 0 : pid_index_lookup(pid) != NULL) {
+        pthread_cond_wait(&live_exit, &live_mutex);
+    }
+    pthread_mutex_unlock(&live_mutex);
+}
+
+const char *pcb_state_name(PcbState state) {
+    switch (state) {
+    case PCB_READY:
+        return "READY";
+    case PCB_RUNNING:
+        return "RUNNING";
+    case PCB_BLOCKED:
+        return "BLOCKED";
+    case PCB_DONE:
+        return "DONE";
+    }
+    return "?";
 }
 
 struct PCB *pcb_create(int start_index, int length) {
-    struct PCB *pcb = (struct PCB *)malloc(sizeof(struct PCB));
+    struct PCB *pcb = NULL;
+    pthread_mutex_lock(&live_mutex);
+    if (pcb_cache != NULL) {
+        pcb = pcb_cache;
+        pcb_cache = pcb->next;
+        pcb_cache_count--;
+    }
+    pthread_mutex_unlock(&live_mutex);
+    if (pcb == NULL) {
+        pcb = alloc_malloc(ALLOC_SCHEDULER, sizeof(struct PCB));
+    }
     if (pcb == NULL) {
         return NULL;
     }
 
-    // Assign unique PID and increment counter
-    pcb->pid = next_pid++;
+    // Assign unique PID and increment counter. The main thread may still
+    // be queueing an exec's jobs while MT workers source scripts.
+    pcb->pid = __atomic_fetch_add(&next_pid, 1, __ATOMIC_RELAXED);
     // Store program location in shell memory
     pcb->start_index = start_index;
     pcb->length = length;
+    pcb->segment = NULL;
     // Start at first instruction
     pcb->pc = 0;
     pcb->job_length_score = length;
     pcb->next = NULL;
+    pcb->state = PCB_READY;
+    pcb->policy = POLICY_FCFS;
+    pcb->wake_ns = 0;
+    pcb->child_pid = -1;
+    pcb->child_fd = -1;
+    pcb->pipe_count = 0;
+
+    pcb->arrival_ns = stats_now();
+    pcb->first_run_ns = 0;
+    pcb->completion_ns = 0;
+    pcb->ready_since_ns = pcb->arrival_ns;
+    pcb->wait_ns = 0;
+    pcb->run_ns = 0;
+    pcb->instructions = 0;
+    pcb->slices = 0;
+    pcb->preemptions = 0;
+    pcb->share_instructions = -1;
+
+    pcb->weight = 1;
+    pcb->deadline = 0;
+    pcb->deadline_unit = DEADLINE_NONE;
+    pcb->arrival_tick = scheduler_instruction_clock();
+    pcb->history_id = -1;
+    pcb->predicted_ns = 0;
+    pcb->heap_key = 0;
+    pcb->heap_seq = 0;
+    pcb->heap_index = -1;
+
+    pcb->vruntime = 0;
+    pcb->fair_slice_start = 0;
+    pcb->rb_left = NULL;
+    pcb->rb_right = NULL;
+    pcb->rb_parent = NULL;
+    pcb->rb_red = 0;
+
+    pthread_mutex_lock(&live_mutex);
+    if (live_count == live_capacity) {
+        int cap = live_capacity ? live_capacity * 2 : 16;
+        struct PCB **grown = alloc_realloc(ALLOC_SCHEDULER, live_pcbs, cap * sizeof(*grown));
+        if (grown == NULL) {
+            pthread_mutex_unlock(&live_mutex);
+            alloc_free(ALLOC_SCHEDULER, pcb);
+            return NULL;
+        }
+        live_pcbs = grown;
+        live_capacity = cap;
+    }
+    if (2 * (live_count + 1) > pid_index_size && pid_index_grow() != 0) {
+        pthread_mutex_unlock(&live_mutex);
+        alloc_free(ALLOC_SCHEDULER, pcb);
+        return NULL;
+    }
+    pcb->live_index = live_count;
+    live_pcbs[live_count++] = pcb;
+    pid_index_insert(pcb);
+    pthread_mutex_unlock(&live_mutex);
 
     return pcb;
 }
 
+struct PCB *pcb_create_segment(struct ProgramSegment *seg) {
+    struct PCB *pcb = pcb_create(mem_segment_start(seg), mem_segment_length(seg));
+    if (pcb != NULL) {
+        pcb->segment = mem_segment_retain(seg);
+    }
+    return pcb;
+}
+
 void pcb_free(struct PCB *pcb) {
     if (pcb != NULL) {
-        free(pcb);
+        TRACE(TRACE_FREE, pcb->pid, pcb->instructions);
+        struct ProgramSegment *seg = pcb->segment;
+
+        // Swap-remove from the live table
+        pthread_mutex_lock(&live_mutex);
+        struct PCB *last = live_pcbs[--live_count];
+        live_pcbs[pcb->live_index] = last;
+        last->live_index = pcb->live_index;
+        pid_index_remove(pcb->pid);
+        pthread_cond_broadcast(&live_exit);
+        if (pcb_cache_count < PCB_CACHE_MAX) {
+            pcb->next = pcb_cache;
+            pcb_cache = pcb;
+            pcb_cache_count++;
+            pcb = NULL;
+        }
+        pthread_mutex_unlock(&live_mutex);
+
+        alloc_free(ALLOC_SCHEDULER, pcb);
+        mem_segment_release(seg);
     }
 }
 
@@ -94,7 +388,11 @@ int pcb_is_done(struct PCB *pcb) {
     if (pcb == NULL) {
         return 1;
     }
-    // Process done when PC reaches program length
+    // Process done when PC reaches program length. A streamed script's
+    // length grows as its input is read.
+    if (pcb->pc >= pcb->length && pcb->segment != NULL) {
+        pcb->length = mem_segment_extend(pcb->segment, pcb->pc);
+    }
     return pcb->pc >= pcb->length;
 }
 
@@ -103,6 +401,9 @@ char *pcb_get_current_instruction(struct PCB *pcb) {
         return NULL;
     }
 
+    if (pcb->segment != NULL) {
+        return mem_segment_line(pcb->segment, pcb->pc);
+    }
     // Calculate actual index: start_index + program counter
     int actual_index = pcb->start_index + pcb->pc;
     return mem_get_program_line(actual_index);
@@ -112,13 +413,20 @@ void pcb_advance(struct PCB *pcb) {
     if (pcb != NULL && !pcb_is_done(pcb)) {
         // Move to next instruction
         pcb->pc++;
+        pcb->instructions++;
+        __atomic_fetch_add(&instruction_clock, 1, __ATOMIC_RELAXED);
     }
 }
 
+uint64_t scheduler_instruction_clock(void) {
+    return __atomic_load_n(&instruction_clock, __ATOMIC_RELAXED);
+}
+
 int scheduler_quantum(SchedulePolicy policy) {
     switch (policy) {
     case POLICY_FCFS:
     case POLICY_SJF:
+    case POLICY_SJF_EST:
         return 0;   // run to completion
     case POLICY_RR:
         return 2;   // time slice 2 (1.2.3)
@@ -126,15 +434,49 @@ int scheduler_quantum(SchedulePolicy policy) {
         return 30;  // time slice 30
     case POLICY_AGING:
         return 1;   // time slice 1 (1.2.4)
+    case POLICY_STRIDE:
+    case POLICY_LOTTERY:
+        return 1;   // re-pick after every instruction for fine-grained shares
+    case POLICY_EDF:
+        return 1;   // preempt at every instruction boundary
+    case POLICY_FAIR:
+        return FAIR_TARGET_LATENCY; // upper bound, see ready_queue_fair_slice
     }
     return 0;
 }
 
+const char *scheduler_policy_name(SchedulePolicy policy) {
+    switch (policy) {
+    case POLICY_FCFS:
+        return "FCFS";
+    case POLICY_SJF:
+        return "SJF";
+    case POLICY_RR:
+        return "RR";
+    case POLICY_RR30:
+        return "RR30";
+    case POLICY_AGING:
+        return "AGING";
+    case POLICY_STRIDE:
+        return "STRIDE";
+    case POLICY_LOTTERY:
+        return "LOTTERY";
+    case POLICY_FAIR:
+        return "FAIR";
+    case POLICY_EDF:
+        return "EDF";
+    case POLICY_SJF_EST:
+        return "SJF_EST";
+    }
+    return "?";
+}
+
 void ready_queue_age(void) {
     struct PCB *p = ready_queue.head;
     while (p != NULL) {
         if (p->job_length_score > 0) {
             p->job_length_score--;
+            TRACE(TRACE_AGE, p->pid, p->job_length_score);
         }
         p = p->next;
     }
@@ -144,6 +486,7 @@ void ready_queue_enqueue_aging(struct PCB *pcb, int reinsert) {
     if (pcb == NULL) {
         return;
     }
+    TRACE(TRACE_ENQUEUE, pcb->pid, pcb->job_length_score);
     pcb->next = NULL;
 
     if (ready_queue.head == NULL) {
@@ -189,9 +532,852 @@ void ready_queue_enqueue_aging(struct PCB *pcb, int reinsert) {
     }
 }
 
+static int heap_less(struct PCB *a, struct PCB *b) {
+    if (a->heap_key != b->heap_key) {
+        return a->heap_key < b->heap_key;
+    }
+    return a->heap_seq < b->heap_seq;
+}
+
+static void heap_place(struct PCB *pcb, int i) {
+    ready_heap[i] = pcb;
+    pcb->heap_index = i;
+}
+
+static void heap_sift_up(int i) {
+    struct PCB *pcb = ready_heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!heap_less(pcb, ready_heap[parent])) {
+            break;
+        }
+        heap_place(ready_heap[parent], i);
+        i = parent;
+    }
+    heap_place(pcb, i);
+}
+
+static void heap_sift_down(int i) {
+    struct PCB *pcb = ready_heap[i];
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= heap_count) {
+            break;
+        }
+        if (child + 1 < heap_count && heap_less(ready_heap[child + 1], ready_heap[child])) {
+            child++;
+        }
+        if (!heap_less(ready_heap[child], pcb)) {
+            break;
+        }
+        heap_place(ready_heap[child], i);
+        i = child;
+    }
+    heap_place(pcb, i);
+}
+
+static int heap_push(struct PCB *pcb) {
+    if (heap_count == heap_capacity) {
+        int cap = heap_capacity ? heap_capacity * 2 : 16;
+        struct PCB **grown = alloc_realloc(ALLOC_SCHEDULER, ready_heap, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return -1;
+        }
+        ready_heap = grown;
+        heap_capacity = cap;
+    }
+    pcb->next = NULL;
+    heap_place(pcb, heap_count++);
+    heap_sift_up(pcb->heap_index);
+    return 0;
+}
+
+// Remove the PCB at position i, keeping the heap ordered
+static void heap_remove_at(int i) {
+    struct PCB *pcb = ready_heap[i];
+    heap_count--;
+    if (i < heap_count) {
+        struct PCB *moved = ready_heap[heap_count];
+        heap_place(moved, i);
+        heap_sift_up(i);
+        heap_sift_down(moved->heap_index);
+    }
+    pcb->heap_index = -1;
+}
+
+static struct PCB *heap_pop(void) {
+    if (heap_count == 0) {
+        return NULL;
+    }
+    struct PCB *top = ready_heap[0];
+    heap_count--;
+    if (heap_count > 0) {
+        heap_place(ready_heap[heap_count], 0);
+        heap_sift_down(0);
+    }
+    top->heap_index = -1;
+    return top;
+}
+
+void ready_queue_enqueue_stride(struct PCB *pcb, int reinsert) {
+    if (pcb == NULL) {
+        return;
+    }
+    TRACE(TRACE_ENQUEUE, pcb->pid, pcb->weight);
+
+    uint64_t stride = STRIDE1 / (pcb->weight > 0 ? pcb->weight : 1);
+    if (reinsert) {
+        pcb->heap_key += stride;
+    } else {
+        pcb->heap_key = stride_global_pass + stride;
+    }
+    // Equal passes run in the order they were reached
+    pcb->heap_seq = heap_next_seq++;
+    if (heap_push(pcb) != 0) {
+        // Out of memory: fall back to FIFO order rather than losing the job
+        ready_queue_enqueue(pcb);
+    }
+}
+
+void ready_queue_enqueue_edf(struct PCB *pcb, int reinsert) {
+    if (pcb == NULL) {
+        return;
+    }
+    TRACE(TRACE_ENQUEUE, pcb->pid, (int)pcb->deadline);
+
+    if (!reinsert) {
+        switch (pcb->deadline_unit) {
+        case DEADLINE_INSTRUCTIONS:
+            pcb->heap_key = pcb->arrival_tick + pcb->deadline;
+            break;
+        case DEADLINE_MS:
+            pcb->heap_key = pcb->arrival_ns + (uint64_t)pcb->deadline * 1000000ULL;
+            break;
+        default:
+            pcb->heap_key = UINT64_MAX;
+            break;
+        }
+        pcb->heap_seq = heap_next_seq++;
+    }
+    if (heap_push(pcb) != 0) {
+        ready_queue_enqueue(pcb);
+    }
+}
+
+static uint32_t lottery_next(void) {
+    lottery_state ^= lottery_state << 13;
+    lottery_state ^= lottery_state >> 17;
+    lottery_state ^= lottery_state << 5;
+    return lottery_state;
+}
+
+struct PCB *ready_queue_dequeue_lottery(void) {
+    if (ready_queue.head == NULL) {
+        return NULL;
+    }
+
+    unsigned long total = 0;
+    for (struct PCB *p = ready_queue.head; p != NULL; p = p->next) {
+        total += p->weight > 0 ? p->weight : 1;
+    }
+    unsigned long ticket = lottery_next() % total;
+
+    // Walk to the holder of the drawn ticket
+    struct PCB *prev = NULL;
+    struct PCB *cur = ready_queue.head;
+    while (cur->next != NULL) {
+        unsigned long tickets = cur->weight > 0 ? cur->weight : 1;
+        if (ticket < tickets) {
+            break;
+        }
+        ticket -= tickets;
+        prev = cur;
+        cur = cur->next;
+    }
+
+    if (prev == NULL) {
+        ready_queue.head = cur->next;
+    } else {
+        prev->next = cur->next;
+    }
+    if (ready_queue.tail == cur) {
+        ready_queue.tail = prev;
+    }
+    cur->next = NULL;
+    TRACE(TRACE_DEQUEUE, cur->pid, cur->weight);
+    return cur;
+}
+
+static int fair_less(struct PCB *a, struct PCB *b) {
+    if (a->vruntime != b->vruntime) {
+        return a->vruntime < b->vruntime;
+    }
+    return a->pid < b->pid;
+}
+
+static void fair_rotate_left(struct PCB *x) {
+    struct PCB *y = x->rb_right;
+    x->rb_right = y->rb_left;
+    if (y->rb_left != FAIR_NIL) {
+        y->rb_left->rb_parent = x;
+    }
+    y->rb_parent = x->rb_parent;
+    if (x->rb_parent == FAIR_NIL) {
+        fair_root = y;
+    } else if (x == x->rb_parent->rb_left) {
+        x->rb_parent->rb_left = y;
+    } else {
+        x->rb_parent->rb_right = y;
+    }
+    y->rb_left = x;
+    x->rb_parent = y;
+}
+
+static void fair_rotate_right(struct PCB *x) {
+    struct PCB *y = x->rb_left;
+    x->rb_left = y->rb_right;
+    if (y->rb_right != FAIR_NIL) {
+        y->rb_right->rb_parent = x;
+    }
+    y->rb_parent = x->rb_parent;
+    if (x->rb_parent == FAIR_NIL) {
+        fair_root = y;
+    } else if (x == x->rb_parent->rb_right) {
+        x->rb_parent->rb_right = y;
+    } else {
+        x->rb_parent->rb_left = y;
+    }
+    y->rb_right = x;
+    x->rb_parent = y;
+}
+
+static struct PCB *fair_minimum(struct PCB *x) {
+    while (x->rb_left != FAIR_NIL) {
+        x = x->rb_left;
+    }
+    return x;
+}
+
+static void fair_insert(struct PCB *z) {
+    struct PCB *parent = FAIR_NIL;
+    struct PCB *x = fair_root;
+    while (x != FAIR_NIL) {
+        parent = x;
+        x = fair_less(z, x) ? x->rb_left : x->rb_right;
+    }
+    z->rb_parent = parent;
+    if (parent == FAIR_NIL) {
+        fair_root = z;
+    } else if (fair_less(z, parent)) {
+        parent->rb_left = z;
+    } else {
+        parent->rb_right = z;
+    }
+    z->rb_left = FAIR_NIL;
+    z->rb_right = FAIR_NIL;
+    z->rb_red = 1;
+
+    if (fair_leftmost == NULL || fair_less(z, fair_leftmost)) {
+        fair_leftmost = z;
+    }
+
+    // Restore the red-black properties (CLRS RB-INSERT-FIXUP)
+    while (z->rb_parent->rb_red) {
+        struct PCB *grand = z->rb_parent->rb_parent;
+        if (z->rb_parent == grand->rb_left) {
+            struct PCB *uncle = grand->rb_right;
+            if (uncle->rb_red) {
+                z->rb_parent->rb_red = 0;
+                uncle->rb_red = 0;
+                grand->rb_red = 1;
+                z = grand;
+            } else {
+                if (z == z->rb_parent->rb_right) {
+                    z = z->rb_parent;
+                    fair_rotate_left(z);
+                }
+                z->rb_parent->rb_red = 0;
+                z->rb_parent->rb_parent->rb_red = 1;
+                fair_rotate_right(z->rb_parent->rb_parent);
+            }
+        } else {
+            struct PCB *uncle = grand->rb_left;
+            if (uncle->rb_red) {
+                z->rb_parent->rb_red = 0;
+                uncle->rb_red = 0;
+                grand->rb_red = 1;
+                z = grand;
+            } else {
+                if (z == z->rb_parent->rb_left) {
+                    z = z->rb_parent;
+                    fair_rotate_right(z);
+                }
+                z->rb_parent->rb_red = 0;
+                z->rb_parent->rb_parent->rb_red = 1;
+                fair_rotate_left(z->rb_parent->rb_parent);
+            }
+        }
+    }
+    fair_root->rb_red = 0;
+}
+
+// Replace the subtree rooted at u with the one rooted at v
+static void fair_transplant(struct PCB *u, struct PCB *v) {
+    if (u->rb_parent == FAIR_NIL) {
+        fair_root = v;
+    } else if (u == u->rb_parent->rb_left) {
+        u->rb_parent->rb_left = v;
+    } else {
+        u->rb_parent->rb_right = v;
+    }
+    v->rb_parent = u->rb_parent;
+}
+
+static void fair_erase(struct PCB *z) {
+    struct PCB *y = z;
+    struct PCB *x;
+    int y_was_red = y->rb_red;
+
+    if (z->rb_left == FAIR_NIL) {
+        x = z->rb_right;
+        fair_transplant(z, z->rb_right);
+    } else if (z->rb_right == FAIR_NIL) {
+        x = z->rb_left;
+        fair_transplant(z, z->rb_left);
+    } else {
+        y = fair_minimum(z->rb_right);
+        y_was_red = y->rb_red;
+        x = y->rb_right;
+        if (y->rb_parent == z) {
+            x->rb_parent = y;
+        } else {
+            fair_transplant(y, y->rb_right);
+            y->rb_right = z->rb_right;
+            y->rb_right->rb_parent = y;
+        }
+        fair_transplant(z, y);
+        y->rb_left = z->rb_left;
+        y->rb_left->rb_parent = y;
+        y->rb_red = z->rb_red;
+    }
+
+    // Restore the red-black properties (CLRS RB-DELETE-FIXUP)
+    if (!y_was_red) {
+        while (x != fair_root && !x->rb_red) {
+            if (x == x->rb_parent->rb_left) {
+                struct PCB *w = x->rb_parent->rb_right;
+                if (w->rb_red) {
+                    w->rb_red = 0;
+                    x->rb_parent->rb_red = 1;
+                    fair_rotate_left(x->rb_parent);
+                    w = x->rb_parent->rb_right;
+                }
+                if (!w->rb_left->rb_red && !w->rb_right->rb_red) {
+                    w->rb_red = 1;
+                    x = x->rb_parent;
+                } else {
+                    if (!w->rb_right->rb_red) {
+                        w->rb_left->rb_red = 0;
+                        w->rb_red = 1;
+                        fair_rotate_right(w);
+                        w = x->rb_parent->rb_right;
+                    }
+                    w->rb_red = x->rb_parent->rb_red;
+                    x->rb_parent->rb_red = 0;
+                    w->rb_right->rb_red = 0;
+                    fair_rotate_left(x->rb_parent);
+                    x = fair_root;
+                }
+            } else {
+                struct PCB *w = x->rb_parent->rb_left;
+                if (w->rb_red) {
+                    w->rb_red = 0;
+                    x->rb_parent->rb_red = 1;
+                    fair_rotate_right(x->rb_parent);
+                    w = x->rb_parent->rb_left;
+                }
+                if (!w->rb_right->rb_red && !w->rb_left->rb_red) {
+                    w->rb_red = 1;
+                    x = x->rb_parent;
+                } else {
+                    if (!w->rb_left->rb_red) {
+                        w->rb_right->rb_red = 0;
+                        w->rb_red = 1;
+                        fair_rotate_left(w);
+                        w = x->rb_parent->rb_left;
+                    }
+                    w->rb_red = x->rb_parent->rb_red;
+                    x->rb_parent->rb_red = 0;
+                    w->rb_left->rb_red = 0;
+                    fair_rotate_right(x->rb_parent);
+                    x = fair_root;
+                }
+            }
+        }
+        x->rb_red = 0;
+    }
+
+    z->rb_left = NULL;
+    z->rb_right = NULL;
+    z->rb_parent = NULL;
+    if (z == fair_leftmost) {
+        fair_leftmost = fair_root == FAIR_NIL ? NULL : fair_minimum(fair_root);
+    }
+}
+
+void ready_queue_enqueue_fair(struct PCB *pcb, int reinsert) {
+    if (pcb == NULL) {
+        return;
+    }
+    TRACE(TRACE_ENQUEUE, pcb->pid, pcb->weight);
+
+    int weight = pcb->weight > 0 ? pcb->weight : 1;
+    if (reinsert) {
+        int ran = pcb->instructions - pcb->fair_slice_start;
+        pcb->vruntime += (uint64_t)ran * FAIR_WEIGHT_SCALE / weight;
+    } else {
+        pcb->vruntime = fair_min_vruntime;
+    }
+    pcb->next = NULL;
+    fair_insert(pcb);
+    fair_count++;
+    fair_total_weight += weight;
+}
+
+static struct PCB *fair_pop(void) {
+    struct PCB *pcb = fair_leftmost;
+    if (pcb == NULL) {
+        return NULL;
+    }
+    fair_erase(pcb);
+    fair_count--;
+    fair_total_weight -= pcb->weight > 0 ? pcb->weight : 1;
+    if (pcb->vruntime > fair_min_vruntime) {
+        fair_min_vruntime = pcb->vruntime;
+    }
+    pcb->fair_slice_start = pcb->instructions;
+    TRACE(TRACE_DEQUEUE, pcb->pid, (int)pcb->vruntime);
+    return pcb;
+}
+
+int ready_queue_fair_slice(struct PCB *pcb) {
+    int weight = pcb->weight > 0 ? pcb->weight : 1;
+    long total = fair_total_weight + weight;
+    int slice = (int)(FAIR_TARGET_LATENCY * (long)weight / total);
+    return slice < FAIR_MIN_GRANULARITY ? FAIR_MIN_GRANULARITY : slice;
+}
+
+static struct PCB *stride_pop(void) {
+    struct PCB *pcb = heap_pop();
+    if (pcb != NULL) {
+        stride_global_pass = pcb->heap_key;
+        TRACE(TRACE_DEQUEUE, pcb->pid, pcb->weight);
+    }
+    return pcb;
+}
+
+struct PCB *ready_queue_dequeue_policy(SchedulePolicy policy) {
+    if (ready_queue.head != NULL) {
+        if (policy == POLICY_LOTTERY) {
+            return ready_queue_dequeue_lottery();
+        }
+        return ready_queue_dequeue();
+    }
+
+    struct PCB *pcb;
+    if (policy == POLICY_FAIR) {
+        pcb = fair_pop();
+        if (pcb == NULL) {
+            pcb = stride_pop();
+        }
+    } else if (policy == POLICY_EDF) {
+        pcb = heap_pop();
+        if (pcb != NULL) {
+            TRACE(TRACE_DEQUEUE, pcb->pid, (int)pcb->deadline);
+        } else {
+            pcb = fair_pop();
+        }
+    } else {
+        pcb = stride_pop();
+        if (pcb == NULL) {
+            pcb = fair_pop();
+        }
+    }
+    return pcb;
+}
+
+// Unlink pcb from the FIFO list. Returns 0 if it was there.
+static int list_remove(struct PCB *pcb) {
+    struct PCB *prev = NULL;
+    for (struct PCB *cur = ready_queue.head; cur != NULL; prev = cur, cur = cur->next) {
+        if (cur != pcb) {
+            continue;
+        }
+        if (prev == NULL) {
+            ready_queue.head = cur->next;
+        } else {
+            prev->next = cur->next;
+        }
+        if (ready_queue.tail == cur) {
+            ready_queue.tail = prev;
+        }
+        cur->next = NULL;
+        return 0;
+    }
+    return -1;
+}
+
+static void fair_remove(struct PCB *pcb) {
+    fair_erase(pcb);
+    fair_count--;
+    fair_total_weight -= pcb->weight > 0 ? pcb->weight : 1;
+}
+
+void scheduler_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t until_ns) {
+    uint64_t now = stats_now();
+    if (until_ns <= now) {
+        return;
+    }
+    uint64_t delta = until_ns - now;
+    struct timespec ts;
+    if (cond == NULL) {
+        ts.tv_sec = delta / 1000000000ULL;
+        ts.tv_nsec = delta % 1000000000ULL;
+        nanosleep(&ts, NULL);
+        return;
+    }
+    // Condition variables time out on the realtime clock
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t ns = (uint64_t)ts.tv_nsec + delta % 1000000000ULL;
+    ts.tv_sec += delta / 1000000000ULL + ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    pthread_cond_timedwait(cond, mutex, &ts);
+}
+
+int scheduler_timeout_ms(uint64_t until_ns, uint64_t now) {
+    if (until_ns == UINT64_MAX) {
+        return -1;
+    }
+    if (until_ns <= now) {
+        return 0;
+    }
+    uint64_t ms = (until_ns - now + 999999) / 1000000;
+    return ms > INT_MAX ? INT_MAX : (int)ms;
+}
+
+// Wake tick of a PCB: rounded up, so it never wakes early
+static uint64_t timer_tick_of(struct PCB *pcb) {
+    return (pcb->wake_ns + TIMER_TICK_NS - 1) / TIMER_TICK_NS;
+}
+
+void timer_wheel_add(struct PCB *pcb) {
+    if (timer_count == 0) {
+        timer_last_tick = stats_now() / TIMER_TICK_NS;
+    }
+    uint64_t tick = timer_tick_of(pcb);
+    if (tick <= timer_last_tick) {
+        // Already due: the bucket of the next tick is the first one visited
+        tick = timer_last_tick + 1;
+        pcb->wake_ns = tick * TIMER_TICK_NS;
+    }
+    struct PCB **slot = &timer_slots[tick % TIMER_SLOTS];
+    pcb->next = *slot;
+    *slot = pcb;
+    timer_count++;
+    if (tick * TIMER_TICK_NS < timer_next) {
+        timer_next = tick * TIMER_TICK_NS;
+    }
+}
+
+struct PCB *timer_wheel_expire(uint64_t now) {
+    uint64_t now_tick = now / TIMER_TICK_NS;
+    if (timer_count == 0 || now_tick <= timer_last_tick) {
+        return NULL;
+    }
+
+    struct PCB *woken = NULL, *woken_tail = NULL;
+    uint64_t ticks = now_tick - timer_last_tick;
+    if (ticks > TIMER_SLOTS) {
+        ticks = TIMER_SLOTS;    // every bucket once
+    }
+    for (uint64_t t = timer_last_tick + 1; t <= timer_last_tick + ticks; t++) {
+        struct PCB **link = &timer_slots[t % TIMER_SLOTS];
+        while (*link != NULL) {
+            struct PCB *pcb = *link;
+            if (timer_tick_of(pcb) > now_tick) {
+                link = &pcb->next;      // due in a later turn of the wheel
+                continue;
+            }
+            *link = pcb->next;
+            pcb->next = NULL;
+            if (woken_tail == NULL) {
+                woken = pcb;
+            } else {
+                woken_tail->next = pcb;
+            }
+            woken_tail = pcb;
+            timer_count--;
+        }
+    }
+    timer_last_tick = now_tick;
+
+    if (woken != NULL) {
+        // Recompute the earliest wake from what is left
+        timer_next = UINT64_MAX;
+        for (int i = 0; i < TIMER_SLOTS && timer_count > 0; i++) {
+            for (struct PCB *p = timer_slots[i]; p != NULL; p = p->next) {
+                if (timer_tick_of(p) * TIMER_TICK_NS < timer_next) {
+                    timer_next = timer_tick_of(p) * TIMER_TICK_NS;
+                }
+            }
+        }
+    }
+    return woken;
+}
+
+int timer_wheel_count(void) {
+    return timer_count;
+}
+
+uint64_t timer_wheel_next_wake(void) {
+    return timer_count > 0 ? timer_next : UINT64_MAX;
+}
+
+static int timer_wheel_remove(struct PCB *pcb) {
+    for (int i = 0; i < TIMER_SLOTS; i++) {
+        for (struct PCB **link = &timer_slots[i]; *link != NULL; link = &(*link)->next) {
+            if (*link == pcb) {
+                *link = pcb->next;
+                pcb->next = NULL;
+                timer_count--;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+// Create child_epoll with child_wakefd in it
+static int child_epoll_open(void) {
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+        return -1;
+    }
+    int wfd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (wfd < 0 || epoll_ctl(ep, EPOLL_CTL_ADD, wfd, &ev) != 0) {
+        if (wfd >= 0) {
+            close(wfd);
+        }
+        close(ep);
+        return -1;
+    }
+    // child_wait_kick reads child_wakefd without a lock
+    __atomic_store_n(&child_wakefd, wfd, __ATOMIC_RELEASE);
+    child_epoll = ep;
+    return 0;
+}
+
+// Reset child_wakefd after it woke an epoll_wait
+static void child_wake_drain(void) {
+    uint64_t count;
+    while (read(child_wakefd, &count, sizeof count) > 0) {
+    }
+}
+
+int child_wait_add(struct PCB *pcb) {
+    int fd = (int)syscall(SYS_pidfd_open, pcb->child_pid, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (child_epoll < 0 && child_epoll_open() != 0) {
+        close(fd);
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = pcb;
+    if (epoll_ctl(child_epoll, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        close(fd);
+        return -1;
+    }
+    pcb->child_fd = fd;
+    child_count++;
+    return 0;
+}
+
+// Stop watching pcb's child and reap it
+static void child_wait_release(struct PCB *pcb) {
+    epoll_ctl(child_epoll, EPOLL_CTL_DEL, pcb->child_fd, NULL);
+    close(pcb->child_fd);
+    waitpid(pcb->child_pid, NULL, 0);
+    pcb->child_fd = -1;
+    pcb->child_pid = -1;
+    child_count--;
+}
+
+void child_wait_sync(struct PCB *pcb) {
+    waitpid(pcb->child_pid, NULL, 0);
+    while (pcb->pipe_count > 0) {
+        waitpid(pcb->pipe_pids[--pcb->pipe_count], NULL, 0);
+    }
+    pcb->child_pid = -1;
+}
+
+struct PCB *child_wait_collect(int timeout_ms) {
+    if (child_count == 0) {
+        return NULL;
+    }
+    struct epoll_event events[16];
+    int n = epoll_wait(child_epoll, events, 16, timeout_ms);
+
+    struct PCB *done = NULL, *tail = NULL;
+    for (int i = 0; i < n; i++) {
+        struct PCB *pcb = events[i].data.ptr;
+        if (pcb == NULL) {
+            child_wake_drain();
+            continue;
+        }
+        child_wait_release(pcb);
+        if (pcb->pipe_count > 0) {
+            // A pipeline: the job wakes once its last child is gone
+            pcb->child_pid = pcb->pipe_pids[--pcb->pipe_count];
+            if (child_wait_add(pcb) == 0) {
+                continue;
+            }
+            child_wait_sync(pcb);
+        }
+        pcb->next = NULL;
+        if (tail == NULL) {
+            done = pcb;
+        } else {
+            tail->next = pcb;
+        }
+        tail = pcb;
+    }
+    return done;
+}
+
+int child_wait_count(void) {
+    return child_count;
+}
+
+void child_wait_block(int timeout_ms) {
+    struct epoll_event events[16];
+    int n = epoll_wait(child_epoll, events, 16, timeout_ms);
+    for (int i = 0; i < n; i++) {
+        // pidfds stay readable until child_wait_collect reaps them
+        if (events[i].data.ptr == NULL) {
+            child_wake_drain();
+        }
+    }
+}
+
+void child_wait_kick(void) {
+    int fd = __atomic_load_n(&child_wakefd, __ATOMIC_ACQUIRE);
+    if (fd >= 0) {
+        uint64_t one = 1;
+        ssize_t r = write(fd, &one, sizeof one);
+        (void)r;
+    }
+}
+
+// Wake one idle MT worker: the one blocked on the epoll set, if any, and
+// one waiting on rq_not_empty. rq_mutex held.
+static void rq_wake_one(void) {
+    pthread_cond_signal(&rq_not_empty);
+    if (rq_polling) {
+        child_wait_kick();
+    }
+}
+
+int ready_queue_remove(struct PCB *pcb) {
+    int removed = 0;
+    pthread_mutex_lock(&rq_mutex);
+    if (pcb->state == PCB_BLOCKED && pcb->child_fd >= 0) {
+        // The job goes, and so do its children
+        kill(pcb->child_pid, SIGKILL);
+        for (int i = 0; i < pcb->pipe_count; i++) {
+            kill(pcb->pipe_pids[i], SIGKILL);
+        }
+        child_wait_release(pcb);
+        while (pcb->pipe_count > 0) {
+            waitpid(pcb->pipe_pids[--pcb->pipe_count], NULL, 0);
+        }
+    } else if (pcb->state == PCB_BLOCKED) {
+        removed = timer_wheel_remove(pcb);
+    } else if (pcb->heap_index >= 0) {
+        heap_remove_at(pcb->heap_index);
+    } else if (pcb->rb_parent != NULL) {
+        fair_remove(pcb);
+    } else {
+        removed = list_remove(pcb);
+    }
+    // An MT exec may be waiting for the queue to drain
+    if (removed == 0 && ready_queue.head == NULL && rq_active_workers == 0
+        && timer_count == 0 && child_count == 0) {
+        pthread_cond_signal(&rq_all_done);
+    }
+    pthread_mutex_unlock(&rq_mutex);
+    return removed;
+}
+
+int ready_queue_renice(struct PCB *pcb, int delta) {
+    switch (pcb->policy) {
+    case POLICY_AGING:
+        pcb->job_length_score += delta;
+        if (pcb->job_length_score < 0) {
+            pcb->job_length_score = 0;
+        }
+        if (list_remove(pcb) == 0) {
+            ready_queue_enqueue_aging(pcb, 0);
+        }
+        return 0;
+    case POLICY_STRIDE:
+    case POLICY_LOTTERY:
+    case POLICY_FAIR: {
+        int weight = pcb->weight - delta;
+        if (weight < 1) weight = 1;
+        if (weight > MAX_WEIGHT) weight = MAX_WEIGHT;
+        if (pcb->rb_parent != NULL) {
+            // The tree caches the total weight: reinsert under the new one
+            fair_remove(pcb);
+            pcb->weight = weight;
+            pcb->next = NULL;
+            fair_insert(pcb);
+            fair_count++;
+            fair_total_weight += weight;
+        } else {
+            // STRIDE strides and LOTTERY tickets use the weight at the next pick
+            pcb->weight = weight;
+        }
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
+
+void ready_queue_policy_reset(void) {
+    stride_global_pass = 0;
+    heap_next_seq = 0;
+    lottery_state = LOTTERY_SEED;
+    fair_min_vruntime = 0;
+}
+
+void pcb_foreach_live(void (*fn)(struct PCB *pcb, void *arg), void *arg) {
+    pthread_mutex_lock(&live_mutex);
+    for (int i = 0; i < live_count; i++) {
+        fn(live_pcbs[i], arg);
+    }
+    pthread_mutex_unlock(&live_mutex);
+}
 
 void ready_queue_enqueue_front(struct PCB *pcb) {
     if (pcb == NULL) return;
+    TRACE(TRACE_ENQUEUE, pcb->pid, 0);
 
     pcb->next = ready_queue.head;
     ready_queue.head = pcb;
@@ -210,6 +1396,7 @@ void ready_queue_mt_init(void) {
 void ready_queue_mt_enqueue(struct PCB *pcb) {
     if (pcb == NULL) return;
 
+    TRACE(TRACE_ENQUEUE, pcb->pid, 0);
     pthread_mutex_lock(&rq_mutex);
     // reuse existing enqueue logic, but without races
     pcb->next = NULL;
@@ -220,12 +1407,13 @@ void ready_queue_mt_enqueue(struct PCB *pcb) {
         ready_queue.tail->next = pcb;
         ready_queue.tail = pcb;
     }
-    pthread_cond_signal(&rq_not_empty);
+    rq_wake_one();
     pthread_mutex_unlock(&rq_mutex);
 }
 
 void ready_queue_mt_enqueue_front(struct PCB *pcb) {
     if (pcb == NULL) return;
+    TRACE(TRACE_ENQUEUE, pcb->pid, 0);
 
     pthread_mutex_lock(&rq_mutex);
     pcb->next = ready_queue.head;
@@ -233,15 +1421,71 @@ void ready_queue_mt_enqueue_front(struct PCB *pcb) {
     if (ready_queue.tail == NULL) {
         ready_queue.tail = pcb;
     }
-    pthread_cond_signal(&rq_not_empty);
+    rq_wake_one();
+    pthread_mutex_unlock(&rq_mutex);
+}
+
+// Append to the tail of the FIFO list. rq_mutex held in MT mode.
+static void mt_append_woken(struct PCB *woken, uint64_t now) {
+    while (woken != NULL) {
+        struct PCB *next = woken->next;
+        woken->next = NULL;
+        woken->state = PCB_READY;
+        woken->ready_since_ns = now;
+        if (ready_queue.head == NULL) {
+            ready_queue.head = woken;
+        } else {
+            ready_queue.tail->next = woken;
+        }
+        ready_queue.tail = woken;
+        woken = next;
+    }
+}
+
+void ready_queue_mt_block(struct PCB *pcb) {
+    pthread_mutex_lock(&rq_mutex);
+    if (pcb->child_pid < 0) {
+        timer_wheel_add(pcb);
+    } else if (child_wait_add(pcb) != 0) {
+        // No pidfds: wait for the children here, as run at the prompt does
+        child_wait_sync(pcb);
+        pcb->next = NULL;
+        mt_append_woken(pcb, stats_now());
+    }
+    // An idle worker must start watching the wheel or the new pidfd
+    rq_wake_one();
     pthread_mutex_unlock(&rq_mutex);
 }
 
-struct PCB *ready_queue_mt_dequeue_blocking(void) {
+struct PCB *ready_queue_mt_dequeue_blocking(uint64_t *now) {
     pthread_mutex_lock(&rq_mutex);
 
-    while (ready_queue.head == NULL && !rq_shutdown) {
-        pthread_cond_wait(&rq_not_empty, &rq_mutex);
+    while (1) {
+        // Move sleepers that are due, and jobs whose child exited, to the
+        // tail of the queue
+        mt_append_woken(timer_wheel_expire(*now), *now);
+        mt_append_woken(child_wait_collect(0), *now);
+        if (ready_queue.head != NULL || rq_shutdown) {
+            break;
+        }
+        if (child_count > 0 && !rq_polling) {
+            // pidfds are not condition variables: block in epoll_wait on
+            // them and on child_wakefd, which rq_wake_one writes
+            int timeout_ms = scheduler_timeout_ms(timer_next, *now);
+            rq_polling = 1;
+            pthread_mutex_unlock(&rq_mutex);
+            child_wait_block(timeout_ms);
+            pthread_mutex_lock(&rq_mutex);
+            rq_polling = 0;
+            // Let another idle worker take over the epoll set
+            pthread_cond_signal(&rq_not_empty);
+        } else if (timer_count > 0) {
+            scheduler_wait_until(&rq_not_empty, &rq_mutex, timer_next);
+        } else {
+            pthread_cond_wait(&rq_not_empty, &rq_mutex);
+        }
+        // Only a wait makes the caller's clock read stale
+        *now = stats_now();
     }
 
     if (rq_shutdown && ready_queue.head == NULL) {
@@ -256,10 +1500,15 @@ struct PCB *ready_queue_mt_dequeue_blocking(void) {
         ready_queue.tail = NULL;
     }
     pcb->next = NULL;
+    if (ready_queue.head != NULL) {
+        // Several jobs woke at once: hand the rest to other workers
+        pthread_cond_signal(&rq_not_empty);
+    }
 
     rq_active_workers++;
 
     pthread_mutex_unlock(&rq_mutex);
+    TRACE(TRACE_DEQUEUE, pcb->pid, 0);
     return pcb;
 }
 
@@ -268,8 +1517,9 @@ void ready_queue_mt_worker_done(void) {
     rq_active_workers--;
     if (rq_active_workers < 0) rq_active_workers = 0;
 
-    // If nobody is running and queue is empty, signal completion
-    if (rq_active_workers == 0 && ready_queue.head == NULL) {
+    // If nobody is running or blocked and queue is empty, signal completion
+    if (rq_active_workers == 0 && ready_queue.head == NULL && timer_count == 0
+        && child_count == 0) {
         pthread_cond_signal(&rq_all_done);
     }
     pthread_mutex_unlock(&rq_mutex);
@@ -277,7 +1527,8 @@ void ready_queue_mt_worker_done(void) {
 
 void ready_queue_mt_wait_all_done(void) {
     pthread_mutex_lock(&rq_mutex);
-    while (!(rq_active_workers == 0 && ready_queue.head == NULL)) {
+    while (!(rq_active_workers == 0 && ready_queue.head == NULL && timer_count == 0
+             && child_count == 0)) {
         pthread_cond_wait(&rq_all_done, &rq_mutex);
     }
     pthread_mutex_unlock(&rq_mutex);
@@ -287,6 +1538,7 @@ void ready_queue_mt_shutdown(void) {
     pthread_mutex_lock(&rq_mutex);
     rq_shutdown = 1;
     pthread_cond_broadcast(&rq_not_empty);
+    child_wait_kick();
     pthread_cond_broadcast(&rq_all_done);
     pthread_mutex_unlock(&rq_mutex);
 }
\ No newline at end of file
@@ -1,19 +1,69 @@
 #ifndef SCHEDULER_H
 #define SCHEDULER_H
 #include <pthread.h>
+#include <stdint.h>
 
 /**
  * Scheduling policy. Used by exec to select enqueue order and time slice.
  * 0 = run to completion (FCFS, SJF); >0 = max instructions before preempt (RR, AGING).
+ * STRIDE and LOTTERY give each program a CPU share proportional to its weight.
+ * FAIR (CFS-style) runs the job with the least weighted virtual runtime.
+ * EDF runs the job with the earliest deadline.
+ * SJF_EST is SJF ordered by predicted burst (history.h) instead of length.
  */
 typedef enum {
     POLICY_FCFS,
     POLICY_SJF,
     POLICY_RR,
     POLICY_RR30,
-    POLICY_AGING
+    POLICY_AGING,
+    POLICY_STRIDE,
+    POLICY_LOTTERY,
+    POLICY_FAIR,
+    POLICY_EDF,
+    POLICY_SJF_EST
 } SchedulePolicy;
 
+/**
+ * Unit of an EDF deadline (exec prog@deadline).
+ */
+typedef enum {
+    DEADLINE_NONE,
+    DEADLINE_INSTRUCTIONS,      // prog@N: N instructions after submission
+    DEADLINE_MS                 // prog@Nms: N milliseconds after submission
+} DeadlineUnit;
+
+// Stride of a weight-1 job; a job's stride is STRIDE1 / weight.
+#define STRIDE1 (1 << 20)
+
+// FAIR: vruntime advances by FAIR_WEIGHT_SCALE / weight per instruction.
+// Every runnable job should run once per FAIR_TARGET_LATENCY instructions,
+// so slices shrink as jobs are added, down to FAIR_MIN_GRANULARITY.
+#define FAIR_WEIGHT_SCALE 1024
+#define FAIR_TARGET_LATENCY 8
+#define FAIR_MIN_GRANULARITY 1
+
+// Largest weight exec prog:weight and nice accept
+#define MAX_WEIGHT 1000
+
+/**
+ * Lifecycle state of a PCB, shown by the jobs command.
+ */
+typedef enum {
+    PCB_READY,                  // In a ready structure, waiting for the CPU
+    PCB_RUNNING,                // Dequeued and executing a time slice
+    PCB_BLOCKED,                // Sleeping in the timer wheel, or waiting for a run child
+    PCB_DONE                    // Finished, about to be freed
+} PcbState;
+
+// Hashed timing wheel for sleeping PCBs: TIMER_SLOTS buckets of
+// TIMER_TICK_NS each; longer sleeps stay in their bucket for extra turns.
+#define TIMER_SLOTS 256
+#define TIMER_TICK_NS 1000000ULL
+
+// Most commands in one run pipeline (run a | run b | ...)
+#define PIPELINE_MAX 16
+
 /**
  * Process Control Block structure.
  *
@@ -24,9 +74,48 @@ struct PCB {
     int pid;                    // Unique process identifier (auto-assigned, starts at 1)
     int start_index;            // Starting index in shell memory where program lines begin
     int length;                 // Total number of lines in the program
+    struct ProgramSegment *segment; // Script it runs (holds a reference), NULL if none
     int pc;                     // Program counter: current instruction index (0-based)
     int job_length_score;       // For AGING: sort key, aged each time slice (min 0)
     struct PCB *next;           // Pointer to next PCB in ready queue (for linked list)
+    PcbState state;
+    SchedulePolicy policy;      // Policy of the exec that created it
+    uint64_t wake_ns;           // BLOCKED: stats_now() time to wake up (links through next)
+    int child_pid;              // BLOCKED: child of a run instruction, -1 if none
+    int child_fd;               // pidfd of child_pid while it is watched, -1 otherwise
+    int pipe_pids[PIPELINE_MAX - 1]; // BLOCKED: other children of a run pipeline, watched
+    int pipe_count;             //   one at a time after child_pid
+
+    // Scheduling metrics (see stats.h). Timestamps are stats_now() nanoseconds, 0 = not yet.
+    uint64_t arrival_ns;        // When the PCB was created
+    uint64_t first_run_ns;      // Start of its first time slice
+    uint64_t completion_ns;     // End of the slice that finished it
+    uint64_t ready_since_ns;    // When it last entered the ready queue
+    uint64_t wait_ns;           // Total time spent waiting in the ready queue
+    uint64_t run_ns;            // Total time spent running
+    int instructions;           // Instructions executed
+    int slices;                 // Time slices received
+    int preemptions;            // Slices that ended with the job unfinished and not blocked
+    int share_instructions;     // Instructions run when the schedule's first job finished (-1 = arrived later)
+
+    int weight;                 // STRIDE/LOTTERY/FAIR: share, from exec prog:weight (default 1)
+    long deadline;              // EDF: relative deadline from exec prog@deadline
+    DeadlineUnit deadline_unit;
+    uint64_t arrival_tick;      // scheduler_instruction_clock() at creation
+    int history_id;             // SJF_EST: burst history entry, -1 if none
+    uint64_t predicted_ns;      // SJF_EST: predicted burst
+    uint64_t heap_key;          // Ready heap order; pass value (STRIDE) or absolute deadline (EDF)
+    uint64_t heap_seq;          // Ready heap tie-break: insertion order
+    int heap_index;             // Position in the ready heap, -1 if not in it
+    int live_index;             // Position in the table of live PCBs (and pid index)
+
+    // FAIR: red-black tree node, ordered by (vruntime, pid)
+    uint64_t vruntime;          // Weighted instructions executed
+    int fair_slice_start;       // instructions when the current slice began
+    struct PCB *rb_left;
+    struct PCB *rb_right;
+    struct PCB *rb_parent;
+    int rb_red;
 };
 
 /**
@@ -77,7 +166,16 @@ int ready_queue_is_empty(void);
 struct PCB *pcb_create(int start_index, int length);
 
 /**
- * Free a PCB structure.
+ * Create a PCB that runs a loaded script. The PCB takes its own reference
+ * to the segment and releases it in pcb_free.
+ *
+ * @param seg Segment from mem_segment_load
+ * @return Pointer to newly allocated PCB, or NULL on failure
+ */
+struct PCB *pcb_create_segment(struct ProgramSegment *seg);
+
+/**
+ * Free a PCB structure, and its script with it if no other PCB runs it.
  *
  * @param pcb Pointer to PCB to free
  */
@@ -112,6 +210,17 @@ void pcb_advance(struct PCB *pcb);
  */
 int scheduler_quantum(SchedulePolicy policy);
 
+/**
+ * Total instructions executed by all PCBs so far. EDF instruction
+ * deadlines are measured on this clock.
+ */
+uint64_t scheduler_instruction_clock(void);
+
+/**
+ * Name of a policy as written on the exec command line ("FCFS", "RR30", ...).
+ */
+const char *scheduler_policy_name(SchedulePolicy policy);
+
 /**
  * Age all jobs in the ready queue: decrease job_length_score by 1, floor at 0.
  * Used by AGING policy after each time slice (do not age the job that just ran).
@@ -128,6 +237,246 @@ void ready_queue_age(void);
  */
 void ready_queue_enqueue_aging(struct PCB *pcb, int reinsert);
 
+/**
+ * Enqueue a PCB on the STRIDE min-heap, ordered by pass value (O(log n)).
+ * An arriving job starts one stride after the pass of the last job picked;
+ * a job that just ran advances its pass by STRIDE1 / weight.
+ *
+ * @param pcb      Pointer to PCB to enqueue
+ * @param reinsert 1 when re-inserting after a time slice, 0 for a new job
+ */
+void ready_queue_enqueue_stride(struct PCB *pcb, int reinsert);
+
+/**
+ * Enqueue a PCB on the EDF min-heap, ordered by absolute deadline
+ * (O(log n)). Jobs without a deadline run after all jobs that have one.
+ * A job that is re-inserted keeps its place among equal deadlines.
+ *
+ * @param pcb      Pointer to PCB to enqueue
+ * @param reinsert 1 when re-inserting after a time slice, 0 for a new job
+ */
+void ready_queue_enqueue_edf(struct PCB *pcb, int reinsert);
+
+/**
+ * Remove and return a lottery winner from the ready queue: every PCB holds
+ * weight tickets and one ticket is drawn uniformly.
+ *
+ * @return Winning PCB, or NULL if the queue is empty
+ */
+struct PCB *ready_queue_dequeue_lottery(void);
+
+/**
+ * Enqueue a PCB on the FAIR red-black tree, ordered by vruntime (O(log n)).
+ * A new job starts at the smallest vruntime picked so far, so it neither
+ * starves nor monopolizes the CPU; a job that just ran is charged
+ * FAIR_WEIGHT_SCALE / weight per instruction of its slice.
+ *
+ * @param pcb      Pointer to PCB to enqueue
+ * @param reinsert 1 when re-inserting after a time slice, 0 for a new job
+ */
+void ready_queue_enqueue_fair(struct PCB *pcb, int reinsert);
+
+/**
+ * Time slice for a FAIR job that was just picked: its weighted share of
+ * FAIR_TARGET_LATENCY among all runnable jobs, at least FAIR_MIN_GRANULARITY.
+ *
+ * @param pcb PCB about to run (already removed from the tree)
+ * @return Number of instructions to run
+ */
+int ready_queue_fair_slice(struct PCB *pcb);
+
+/**
+ * Remove and return the next PCB to run under a policy.
+ * The FIFO list is served first (background batch scripts and jobs from
+ * nested execs; LOTTERY draws from it instead), then the policy's own
+ * structure (STRIDE/EDF heap or FAIR tree), then the other one.
+ *
+ * @param policy Policy of the running schedule
+ * @return Next PCB, or NULL if nothing is ready
+ */
+struct PCB *ready_queue_dequeue_policy(SchedulePolicy policy);
+
+/**
+ * Reset per-schedule policy state (STRIDE global pass, LOTTERY random
+ * seed, FAIR minimum vruntime) so that every top-level exec is reproducible.
+ */
+void ready_queue_policy_reset(void);
+
+/**
+ * Call fn on every PCB that has been created and not yet freed.
+ *
+ * @param fn  Callback
+ * @param arg Passed through to fn
+ */
+void pcb_foreach_live(void (*fn)(struct PCB *pcb, void *arg), void *arg);
+
+/**
+ * Name of a PCB state as shown by jobs ("READY", "RUNNING", ...).
+ */
+const char *pcb_state_name(PcbState state);
+
+/**
+ * Look up a live PCB by pid (O(1) hash index).
+ *
+ * @param pid PID to look for
+ * @return The PCB, or NULL if no live PCB has this pid
+ */
+struct PCB *pcb_find(int pid);
+
+/**
+ * Kill a job. A queued or blocked job is taken out of the ready
+ * structures (its run children killed) and freed; a running one (a slice
+ * in progress, possibly the caller's own) finishes at the next
+ * instruction boundary. Lookup and removal happen under one lock, so an
+ * MT worker cannot free the PCB in between.
+ *
+ * @param pid PID of the job
+ * @return 0, or -1 if no live PCB has this pid
+ */
+int pcb_kill(int pid);
+
+/**
+ * Look up a job and change its priority, as ready_queue_renice, under one
+ * lock.
+ *
+ * @param pid   PID of the job
+ * @param delta Priority change
+ * @return 0, -1 if no live PCB has this pid, -2 if its policy has no priority
+ */
+int pcb_renice(int pid, int delta);
+
+/**
+ * Block until the PCB with this pid has been freed, or, for pid 0, until
+ * no PCB is live. Returns at once if there is nothing to wait for.
+ *
+ * @param pid PID to wait for, or 0 for all
+ */
+void pcb_wait_exit(int pid);
+
+/**
+ * Remove a PCB from whichever ready structure holds it (list, heap or
+ * tree). Safe in MT mode.
+ *
+ * @param pcb PCB to remove
+ * @return 0 if it was removed, -1 if it was not queued (e.g. running)
+ */
+int ready_queue_remove(struct PCB *pcb);
+
+/**
+ * Change a PCB's priority by delta, as the Unix nice does: a positive
+ * delta makes it less favoured. AGING adds delta to the score (floor 0);
+ * STRIDE, LOTTERY and FAIR subtract it from the weight (1..MAX_WEIGHT).
+ * A queued PCB is moved to its new position.
+ *
+ * @param pcb   PCB to change
+ * @param delta Priority change
+ * @return 0 on success, -1 if its policy has no priority
+ */
+int ready_queue_renice(struct PCB *pcb, int delta);
+
+/**
+ * Wait on cond (with mutex held) until it is signalled or until the
+ * stats_now() time until_ns. With a NULL cond, just sleep until then.
+ *
+ * @param cond     Condition variable, or NULL
+ * @param mutex    Mutex held by the caller (ignored if cond is NULL)
+ * @param until_ns stats_now() time to return by
+ */
+void scheduler_wait_until(pthread_cond_t *cond, pthread_mutex_t *mutex, uint64_t until_ns);
+
+/**
+ * Convert a stats_now() deadline into an epoll_wait timeout, rounded up
+ * so the caller never wakes early.
+ *
+ * @param until_ns stats_now() time to wake by (UINT64_MAX = never)
+ * @param now      Current stats_now() value
+ * @return Milliseconds to wait, 0 if already due, -1 for no timeout
+ */
+int scheduler_timeout_ms(uint64_t until_ns, uint64_t now);
+
+/**
+ * Park a BLOCKED PCB in the timer wheel until pcb->wake_ns (O(1)).
+ *
+ * @param pcb PCB to park
+ */
+void timer_wheel_add(struct PCB *pcb);
+
+/**
+ * Remove and return the PCBs whose wake time has passed, linked through
+ * next. Only the buckets of the ticks since the last call are visited.
+ *
+ * @param now Current stats_now() value
+ * @return List of woken PCBs (NULL if none)
+ */
+struct PCB *timer_wheel_expire(uint64_t now);
+
+/**
+ * @return Number of PCBs in the timer wheel
+ */
+int timer_wheel_count(void);
+
+/**
+ * @return Earliest wake time in the wheel, or UINT64_MAX if it is empty
+ */
+uint64_t timer_wheel_next_wake(void);
+
+/**
+ * Watch the child of a BLOCKED PCB (pcb->child_pid) through a pidfd in
+ * an epoll set, so the scheduler can run other jobs until it exits.
+ *
+ * @param pcb PCB whose run child to watch
+ * @return 0 on success, -1 if pidfds are unavailable (caller must waitpid)
+ */
+int child_wait_add(struct PCB *pcb);
+
+/**
+ * Wait here, without the epoll set, for every child of a BLOCKED PCB
+ * (child_pid and pipe_pids). Fallback when child_wait_add fails.
+ *
+ * @param pcb PCB whose run children to reap
+ */
+void child_wait_sync(struct PCB *pcb);
+
+/**
+ * Reap the children that have exited and return the PCBs whose children
+ * have all exited, linked through next.
+ *
+ * @param timeout_ms How long to wait for a child to exit (-1 = forever)
+ * @return List of PCBs whose child exited (NULL if none)
+ */
+struct PCB *child_wait_collect(int timeout_ms);
+
+/**
+ * @return Number of PCBs waiting for a run child
+ */
+int child_wait_count(void);
+
+/**
+ * Block until a run child exits, child_wait_kick is called, or timeout_ms
+ * passes, without reaping anything: call child_wait_collect afterwards.
+ * Needs child_wait_count() > 0; the caller must not hold the lock that
+ * guards the child set.
+ *
+ * @param timeout_ms How long to wait (-1 = forever)
+ */
+void child_wait_block(int timeout_ms);
+
+/**
+ * Wake a thread blocked on the child epoll set (child_wait_block or
+ * child_wait_collect), e.g. because new work was queued. Thread-safe; a
+ * kick with nobody waiting makes the next wait return at once.
+ */
+void child_wait_kick(void);
+
+/**
+ * Park a BLOCKED PCB in MT mode (thread-safe): in the timer wheel, or, if
+ * it has a run child, until the child exits. Idle workers wake it;
+ * ready_queue_mt_wait_all_done waits for it too.
+ *
+ * @param pcb PCB to park
+ */
+void ready_queue_mt_block(struct PCB *pcb);
+
 /**
  * Enqueue a PCB at the head of the ready queue.
  *
@@ -163,11 +512,16 @@ void ready_queue_mt_enqueue_front(struct PCB *pcb);
 /**
  * Dequeue a PCB in MT mode (thread-safe, blocking).
  *
- * Blocks until a PCB is available or shutdown is requested.
+ * Blocks until a PCB is available or shutdown is requested. While only
+ * sleeping PCBs remain, the caller sleeps until the earliest wakes up;
+ * while run children are pending, one idle worker blocks on their pidfds.
  *
+ * @param now In: the caller's last stats_now() value (the end of its
+ *            previous slice). Out: the time the PCB was dequeued, which
+ *            is read again only if the call had to wait.
  * @return Pointer to PCB, or NULL if shutdown and queue is empty
  */
-struct PCB *ready_queue_mt_dequeue_blocking(void);
+struct PCB *ready_queue_mt_dequeue_blocking(uint64_t *now);
 
 /**
  * Notify the queue that a worker finished a time slice.
@@ -36,11 +36,12 @@ int main(int argc, char *argv[]) {
         // here you should check the unistd library 
         // so that you can find a way to not display $ in the batch mode
         fgets(userInput, MAX_USER_INPUT - 1, stdin);
-        errorCode = parseInput(userInput);
+        errorCode = prompt_job(userInput);
         if (errorCode == -1)
             exit(99);           // ignore all other errors
 
         if (feof(stdin)) {
+            background_wait();
             return 0;
         }
 
@@ -57,8 +58,11 @@ int wordEnding(char c) {
 }
 
 int parseInput(char inp[]) {
-    char tmp[200], *words[100];
-    int ix = 0, w = 0;
+    // Words are copied into text, one after another, rather than strdup'd:
+    // they only live while this line runs. At most 1000 characters are read,
+    // plus a terminator per word.
+    char text[1000 + 100], *words[100];
+    int ix = 0, w = 0, used = 0;
     int wordlen;
     int errorCode = 0;
 
@@ -71,7 +75,7 @@ int parseInput(char inp[]) {
     // command dispatch, and this function is really acting as a complete
     // parser rather than just a tokenizer. So we'll handle it here.
 
-    while (inp[ix] != '\n' && inp[ix] != '\0' && ix < 1000) {
+    while (inp[ix] != '\n' && inp[ix] != '\0' && ix < 1000 && w < 100) {
         // skip white spaces
         for (; isspace(inp[ix]) && inp[ix] != '\n' && ix < 1000; ix++);
 
@@ -81,13 +85,13 @@ int parseInput(char inp[]) {
             break;
 
         // extract a word
+        words[w] = &text[used];
         for (wordlen = 0; !wordEnding(inp[ix]) && ix < 1000; ix++, wordlen++) {
-            tmp[wordlen] = inp[ix];
+            text[used++] = inp[ix];
         }
 
         if (wordlen > 0) {
-            tmp[wordlen] = '\0';
-            words[w] = strdup(tmp);
+            text[used++] = '\0';
             w++;
             if (inp[ix] == '\0')
                 break;
@@ -99,9 +103,6 @@ int parseInput(char inp[]) {
     // interpreter if actually found words.
     if (w > 0) {
         errorCode = interpreter(words, w);
-        for (size_t i = 0; i < w; ++i) {
-            free(words[i]);
-        }
     }
     if (inp[ix] == ';') {
         // handle the next command in the chain by recursing
@@ -1,7 +1,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
 #include "shellmemory.h"
+#include "mysc.h"
+#include "alloc.h"
+#include "arena.h"
 
 struct memory_struct {
     char *var;
@@ -10,12 +14,75 @@ struct memory_struct {
 
 struct memory_struct shellmemory[MEM_SIZE];
 
-// Program line storage - array of strings holding loaded program lines
+// Marks a free variable slot (var and value both point here)
+static char mem_none[] = "none";
+
+// Program line storage - array of strings holding loaded program lines.
+// Each loaded script owns a contiguous range (its segment); NULL marks a
+// free line.
 char *program_lines[MEM_SIZE];
 
-// Counter tracking number of program lines currently loaded
+// One past the last line in use
 int program_line_count = 0;
 
+// A loaded script: program_lines[start .. start + size - 1]. Text lines
+// live in the segment's own arena; the lines of a .mysc image point into
+// its read-only mapping. The segment goes with its last reference: the
+// PCBs running it, and the loader until it has created them.
+//
+// A streamed script (the rest of stdin) holds a ring of STREAM_WINDOW
+// lines: line i is in slot i % STREAM_WINDOW, read when the script gets
+// there into the slot of a line already run.
+struct ProgramSegment {
+    int start;
+    int size;                   // Lines held in the table
+    int length;                 // Lines of the script (streamed: read so far)
+    int refs;
+    struct Arena text;
+    void *map_base;             // .mysc mapping, or NULL
+    size_t map_size;
+    FILE *stream;               // Input still to read, NULL if none
+    int closed;                 // Stream cut off (its job was killed)
+    struct ProgramSegment *prev, *next;
+};
+
+// Set while a streamed segment owns stdin
+static int stdin_streaming = 0;
+
+// Live segments. program_mutex covers the list, the line table and
+// program_line_count; a segment's own lines are read without it, since
+// they cannot change while the reader holds a reference.
+static struct ProgramSegment *segments = NULL;
+static pthread_mutex_t program_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// A script load: opened (or mapped) by the caller, then read into a
+// segment by a loader thread or by whoever waits for it
+struct LoadJob {
+    char *filename;
+    FILE *file;                 // Text script, open until read
+    struct MyscImage image;     // Compiled script, mapped and checked
+    int mapped;
+    struct ProgramSegment *seg;
+    int done;
+    int taken;                  // seg handed to the caller
+    struct LoadJob *next;       // Queue link
+};
+
+// The loads of one mem_load_start call
+struct LoadBatch {
+    int count;
+    struct LoadJob jobs[LOAD_MANY_MAX];
+};
+
+// Loader pool: threads started on first use that take jobs off load_queue
+// (FIFO). Callers wait on load_done for their own jobs and meanwhile take
+// queued jobs themselves, so loads go ahead even without threads.
+static struct LoadJob *load_queue = NULL, *load_queue_tail = NULL;
+static int loader_count = 0;
+static pthread_mutex_t load_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t load_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t load_done = PTHREAD_COND_INITIALIZER;
+
 /**
  * Helper function to match variable names.
  *
@@ -38,8 +105,8 @@ int match(char *model, char *var) {
 void mem_init() {
     int i;
     for (i = 0; i < MEM_SIZE; i++) {
-        shellmemory[i].var = "none";
-        shellmemory[i].value = "none";
+        shellmemory[i].var = mem_none;
+        shellmemory[i].value = mem_none;
     }
     // Initialize program line storage
     program_line_count = 0;
@@ -53,7 +120,11 @@ void mem_set_value(char *var_in, char *value_in) {
 
     for (i = 0; i < MEM_SIZE; i++) {
         if (strcmp(shellmemory[i].var, var_in) == 0) {
-            shellmemory[i].value = strdup(value_in);
+            // Overwrite: the old value was leaked here before
+            if (shellmemory[i].value != mem_none) {
+                alloc_free(ALLOC_VARS, shellmemory[i].value);
+            }
+            shellmemory[i].value = alloc_strdup(ALLOC_VARS, value_in);
             return;
         }
     }
@@ -61,8 +132,8 @@ void mem_set_value(char *var_in, char *value_in) {
     // Value does not exist, need to find a free spot.
     for (i = 0; i < MEM_SIZE; i++) {
         if (strcmp(shellmemory[i].var, "none") == 0) {
-            shellmemory[i].var = strdup(var_in);
-            shellmemory[i].value = strdup(value_in);
+            shellmemory[i].var = alloc_strdup(ALLOC_VARS, var_in);
+            shellmemory[i].value = alloc_strdup(ALLOC_VARS, value_in);
             return;
         }
     }
@@ -75,130 +146,451 @@ char *mem_get_value(char *var_in) {
 
     for (i = 0; i < MEM_SIZE; i++) {
         if (strcmp(shellmemory[i].var, var_in) == 0) {
-            return strdup(shellmemory[i].value);
+            return alloc_strdup(ALLOC_VARS, shellmemory[i].value);
         }
     }
     return NULL;
 }
 
-int mem_load_program(char *filename) {
-    FILE *p = fopen(filename, "rt");
-    if (p == NULL) {
-        return -1;
+int mem_get_var_count(void) {
+    int count = 0;
+    for (int i = 0; i < MEM_SIZE; i++) {
+        if (shellmemory[i].var != mem_none) {
+            count++;
+        }
     }
+    return count;
+}
 
-    char line[101];  // Max line length is 100 chars + null terminator
-    int lines_loaded = 0;
+// Read one line, without its newline / carriage return. Lines longer
+// than 100 chars are split. Returns 0 at end of input.
+static int read_line(FILE *f, char line[101]) {
+    if (fgets(line, 101, f) == NULL) {
+        return 0;
+    }
+    int len = strlen(line);
+    if (len > 0 && line[len - 1] == '\n') {
+        line[--len] = '\0';
+    }
+    if (len > 0 && line[len - 1] == '\r') {
+        line[--len] = '\0';
+    }
+    return 1;
+}
+
+static struct ProgramSegment *segment_new(void) {
+    struct ProgramSegment *seg = alloc_calloc(ALLOC_PROGRAM, 1, sizeof(*seg));
+    if (seg != NULL) {
+        seg->refs = 1;
+        seg->text = (struct Arena)ARENA_INIT(ALLOC_PROGRAM);
+    }
+    return seg;
+}
+
+// Free a segment that is not (or no longer) in the line table
+static void segment_free(struct ProgramSegment *seg) {
+    if (seg->stream != NULL) {
+        // The job went before its input ran out: the rest of the batch is
+        // dropped with it, not left for the prompt
+        char line[101];
+        while (read_line(seg->stream, line));
+        __atomic_store_n(&stdin_streaming, 0, __ATOMIC_RELEASE);
+    }
+    arena_release(&seg->text);
+    if (seg->map_base != NULL) {
+        mysc_unmap(seg->map_base, seg->map_size);
+    }
+    alloc_free(ALLOC_PROGRAM, seg);
+}
 
-    // Clear any existing program first
-    mem_clear_program();
+// Take a segment's lines out of the table. program_mutex held.
+static void segment_unlink(struct ProgramSegment *seg) {
+    for (int i = seg->start; i < seg->start + seg->size; i++) {
+        program_lines[i] = NULL;
+    }
+    while (program_line_count > 0 && program_lines[program_line_count - 1] == NULL) {
+        program_line_count--;
+    }
+    if (seg->prev != NULL) {
+        seg->prev->next = seg->next;
+    } else {
+        segments = seg->next;
+    }
+    if (seg->next != NULL) {
+        seg->next->prev = seg->prev;
+    }
+}
 
-    // Read all lines from file
-    while (fgets(line, sizeof(line), p) != NULL && program_line_count < MEM_SIZE) {
-        // Remove newline if present
-        int len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
+// Start of the first n free lines in a row (lines from program_line_count
+// on are free), or -1. program_mutex held.
+static int range_find(int n) {
+    if (n == 0) {
+        return program_line_count;
+    }
+    int run = 0;
+    for (int i = 0; i < MEM_SIZE; i++) {
+        if (i >= program_line_count || program_lines[i] == NULL) {
+            if (++run == n) {
+                return i - n + 1;
+            }
+        } else {
+            run = 0;
         }
-        if (len > 0 && line[len - 1] == '\r') {
-            line[len - 1] = '\0';
+    }
+    return -1;
+}
+
+// Give a segment n lines of the table, reusing the lines of finished
+// scripts. Returns -1 if there are not n free lines in a row.
+static int segment_place(struct ProgramSegment *seg, char **lines, int n) {
+    pthread_mutex_lock(&program_mutex);
+    int start = range_find(n);
+    if (start < 0) {
+        pthread_mutex_unlock(&program_mutex);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        program_lines[start + i] = lines[i];
+    }
+    if (start + n > program_line_count) {
+        program_line_count = start + n;
+    }
+    seg->start = start;
+    seg->size = n;
+    seg->length = n;
+    seg->prev = NULL;
+    seg->next = segments;
+    if (segments != NULL) {
+        segments->prev = seg;
+    }
+    segments = seg;
+    pthread_mutex_unlock(&program_mutex);
+    return 0;
+}
+
+// Read up to MEM_SIZE lines into an arena. Returns the number read, or -1
+// if out of memory.
+static int read_lines(FILE *f, struct Arena *text, char **lines) {
+    char line[101];  // Max line length is 100 chars + null terminator
+    int n = 0;
+    while (n < MEM_SIZE && read_line(f, line)) {
+        lines[n] = arena_strdup(text, line);
+        if (lines[n] == NULL) {
+            return -1;
         }
+        n++;
+    }
+    return n;
+}
 
-        // Store the line (duplicate the string)
-        program_lines[program_line_count] = strdup(line);
-        program_line_count++;
-        lines_loaded++;
+// First half of a load: open the script, or map a .mysc image and check
+// it. Returns -1 if the script is missing or the image is corrupt.
+static int load_open(struct LoadJob *job) {
+    job->file = NULL;
+    job->mapped = 0;
+    if (mysc_is_image(job->filename)) {
+        if (mysc_map(job->filename, &job->image) != 0) {
+            return -1;
+        }
+        job->mapped = 1;
+        return 0;
     }
+    job->file = fopen(job->filename, "rt");
+    return job->file == NULL ? -1 : 0;
+}
 
-    fclose(p);
-    return lines_loaded;
+// Second half: read the opened script into a new segment. Returns NULL if
+// out of memory or program memory.
+static struct ProgramSegment *load_read(struct LoadJob *job) {
+    struct ProgramSegment *seg = segment_new();
+    char *lines[MEM_SIZE];
+    int n = -1;
+    if (job->mapped) {
+        // Compiled: the lines are used in place, nothing is read or copied.
+        // The segment owns the mapping from here on.
+        if (seg == NULL) {
+            mysc_unmap(job->image.base, job->image.size);
+            return NULL;
+        }
+        seg->map_base = job->image.base;
+        seg->map_size = job->image.size;
+        n = job->image.header->count < MEM_SIZE ? (int)job->image.header->count : MEM_SIZE;
+        for (int i = 0; i < n; i++) {
+            lines[i] = (char *)mysc_line(&job->image, i);
+        }
+    } else {
+        if (seg != NULL) {
+            n = read_lines(job->file, &seg->text, lines);  // longer scripts are cut at MEM_SIZE
+        }
+        fclose(job->file);
+    }
+    if (seg != NULL && (n < 0 || segment_place(seg, lines, n) != 0)) {
+        segment_free(seg);
+        return NULL;
+    }
+    return seg;
 }
 
-char *mem_get_program_line(int index) {
-    if (index < 0 || index >= program_line_count) {
+struct ProgramSegment *mem_segment_load(char *filename) {
+    struct LoadJob job;
+    job.filename = filename;
+    if (load_open(&job) != 0) {
         return NULL;
     }
-    return program_lines[index];
+    return load_read(&job);
 }
 
-int mem_get_program_line_count(void) {
-    return program_line_count;
+// Next queued load, or NULL. load_mutex held.
+static struct LoadJob *load_take(void) {
+    struct LoadJob *job = load_queue;
+    if (job != NULL) {
+        load_queue = job->next;
+        if (load_queue == NULL) {
+            load_queue_tail = NULL;
+        }
+    }
+    return job;
 }
 
-void mem_clear_program(void) {
-    int i;
-    for (i = 0; i < program_line_count; i++) {
-        if (program_lines[i] != NULL) {
-            free(program_lines[i]);
-            program_lines[i] = NULL;
+// Run a load with load_mutex held (it is dropped meanwhile)
+static void load_run(struct LoadJob *job) {
+    pthread_mutex_unlock(&load_mutex);
+    struct ProgramSegment *seg = load_read(job);
+    pthread_mutex_lock(&load_mutex);
+    job->seg = seg;
+    job->done = 1;
+    pthread_cond_broadcast(&load_done);
+}
+
+static void *loader_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&load_mutex);
+    for (;;) {
+        struct LoadJob *job = load_take();
+        if (job == NULL) {
+            pthread_cond_wait(&load_work, &load_mutex);
+        } else {
+            load_run(job);
         }
     }
-    program_line_count = 0;
+    return NULL;
 }
 
-int mem_append_program(char *filename) {
-    FILE *p = fopen(filename, "rt");
-    if (p == NULL) {
-        return -1;
+struct LoadBatch *mem_load_start(char *filenames[], int n) {
+    if (n > LOAD_MANY_MAX) {
+        return NULL;
+    }
+    struct LoadBatch *batch = alloc_malloc(ALLOC_PROGRAM, sizeof(*batch));
+    if (batch == NULL) {
+        return NULL;
+    }
+    // Every script is opened before any is read: all of them or none
+    batch->count = n;
+    for (int i = 0; i < n; i++) {
+        struct LoadJob *job = &batch->jobs[i];
+        job->filename = filenames[i];
+        if (load_open(job) != 0) {
+            for (int k = 0; k < i; k++) {
+                if (batch->jobs[k].mapped) {
+                    mysc_unmap(batch->jobs[k].image.base, batch->jobs[k].image.size);
+                } else {
+                    fclose(batch->jobs[k].file);
+                }
+            }
+            alloc_free(ALLOC_PROGRAM, batch);
+            return NULL;
+        }
+        job->seg = NULL;
+        job->done = 0;
+        job->taken = 0;
+        job->next = NULL;
     }
 
-    char line[101];
-    int lines_loaded = 0;
+    pthread_mutex_lock(&load_mutex);
+    // One loader per script after the first, which the caller reads
+    while (loader_count < n - 1 && loader_count < LOADER_THREADS) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, loader_main, NULL) != 0) {
+            break;      // fewer loaders; the caller takes their jobs
+        }
+        pthread_detach(tid);
+        loader_count++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (load_queue_tail != NULL) {
+            load_queue_tail->next = &batch->jobs[i];
+        } else {
+            load_queue = &batch->jobs[i];
+        }
+        load_queue_tail = &batch->jobs[i];
+    }
+    pthread_cond_broadcast(&load_work);
+    pthread_mutex_unlock(&load_mutex);
+    return batch;
+}
+
+int mem_load_ready(struct LoadBatch *batch, int i) {
+    pthread_mutex_lock(&load_mutex);
+    int done = batch->jobs[i].done;
+    pthread_mutex_unlock(&load_mutex);
+    return done;
+}
 
-    while (fgets(line, sizeof(line), p) != NULL && program_line_count < MEM_SIZE) {
-        int len = strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
+// Wait for a job, reading queued scripts meanwhile. load_mutex held.
+static void load_wait(struct LoadJob *target) {
+    while (!target->done) {
+        struct LoadJob *job = load_take();
+        if (job != NULL) {
+            load_run(job);
+        } else {
+            pthread_cond_wait(&load_done, &load_mutex);
         }
-        if (len > 0 && line[len - 1] == '\r') {
-            line[len - 1] = '\0';
+    }
+}
+
+struct ProgramSegment *mem_load_take(struct LoadBatch *batch, int i) {
+    pthread_mutex_lock(&load_mutex);
+    load_wait(&batch->jobs[i]);
+    batch->jobs[i].taken = 1;
+    pthread_mutex_unlock(&load_mutex);
+    return batch->jobs[i].seg;
+}
+
+void mem_load_finish(struct LoadBatch *batch) {
+    pthread_mutex_lock(&load_mutex);
+    for (int i = 0; i < batch->count; i++) {
+        load_wait(&batch->jobs[i]);
+    }
+    pthread_mutex_unlock(&load_mutex);
+    for (int i = 0; i < batch->count; i++) {
+        if (!batch->jobs[i].taken) {
+            mem_segment_release(batch->jobs[i].seg);
         }
+    }
+    alloc_free(ALLOC_PROGRAM, batch);
+}
 
-        program_lines[program_line_count] = strdup(line);
-        program_line_count++;
-        lines_loaded++;
+struct ProgramSegment *mem_segment_load_stdin(void) {
+    struct ProgramSegment *seg = segment_new();
+    if (seg == NULL) {
+        return NULL;
+    }
+    if (__atomic_load_n(&stdin_streaming, __ATOMIC_ACQUIRE)) {
+        // stdin already feeds a script: nothing left for this one
+        if (segment_place(seg, NULL, 0) != 0) {
+            segment_free(seg);
+            return NULL;
+        }
+        return seg;
+    }
+    char *slots[STREAM_WINDOW];
+    char *ring = arena_alloc(&seg->text, STREAM_WINDOW * 101);
+    if (ring == NULL) {
+        segment_free(seg);
+        return NULL;
+    }
+    for (int i = 0; i < STREAM_WINDOW; i++) {
+        slots[i] = ring + i * 101;
+        slots[i][0] = '\0';
+    }
+    if (segment_place(seg, slots, STREAM_WINDOW) != 0) {
+        segment_free(seg);
+        return NULL;
+    }
+    // Read ahead a window: a batch that fits is then loaded whole, with
+    // its length known before it runs
+    int n = 0;
+    while (n < STREAM_WINDOW && read_line(stdin, slots[n])) {
+        n++;
     }
+    seg->length = n;
+    if (n == STREAM_WINDOW) {
+        seg->stream = stdin;
+        __atomic_store_n(&stdin_streaming, 1, __ATOMIC_RELEASE);
+    }
+    return seg;
+}
 
-    fclose(p);
-    // Out of space: hit MEM_SIZE and may have truncated the file
-    if (program_line_count >= MEM_SIZE && lines_loaded > 0) {
-        return -1;
+int mem_segment_extend(struct ProgramSegment *seg, int pc) {
+    if (seg->stream == NULL || pc < seg->length || __atomic_load_n(&seg->closed, __ATOMIC_ACQUIRE)) {
+        return seg->length;
+    }
+    // Line pc goes in the slot of line pc - STREAM_WINDOW, which has run
+    if (read_line(seg->stream, program_lines[seg->start + pc % STREAM_WINDOW])) {
+        seg->length++;
+    } else {
+        seg->stream = NULL;
+        __atomic_store_n(&stdin_streaming, 0, __ATOMIC_RELEASE);
     }
-    return lines_loaded;
+    return seg->length;
 }
 
+void mem_segment_close(struct ProgramSegment *seg) {
+    if (seg != NULL) {
+        __atomic_store_n(&seg->closed, 1, __ATOMIC_RELEASE);
+    }
+}
 
-// Loads the remaining lines from stdin into program_lines (append or clear-first).
-// Returns number of lines loaded, or -1 on overflow / error.
-int mem_load_program_from_stdin(int clear_first) {
-    char line[101];
-    int lines_loaded = 0;
+int mem_stdin_streaming(void) {
+    return __atomic_load_n(&stdin_streaming, __ATOMIC_ACQUIRE);
+}
 
-    if (clear_first) {
-        mem_clear_program();
+char *mem_segment_line(const struct ProgramSegment *seg, int index) {
+    if (index < 0 || index >= seg->length) {
+        return NULL;
     }
+    // A streamed script wraps around its window; other scripts never reach
+    // their size
+    return program_lines[seg->start + index % seg->size];
+}
 
-    while (fgets(line, sizeof(line), stdin) != NULL) {
-        // Stop if out of space
-        if (program_line_count >= MEM_SIZE) {
-            return -1;
-        }
+struct ProgramSegment *mem_segment_retain(struct ProgramSegment *seg) {
+    if (seg != NULL) {
+        __atomic_add_fetch(&seg->refs, 1, __ATOMIC_RELAXED);
+    }
+    return seg;
+}
 
-        // Trim newline / carriage return
-        int len = (int)strlen(line);
-        if (len > 0 && line[len - 1] == '\n') {
-            line[len - 1] = '\0';
-            len--;
-        }
-        if (len > 0 && line[len - 1] == '\r') {
-            line[len - 1] = '\0';
-            len--;
-        }
+void mem_segment_release(struct ProgramSegment *seg) {
+    if (seg == NULL || __atomic_sub_fetch(&seg->refs, 1, __ATOMIC_ACQ_REL) != 0) {
+        return;
+    }
+    pthread_mutex_lock(&program_mutex);
+    segment_unlink(seg);
+    pthread_mutex_unlock(&program_mutex);
+    segment_free(seg);
+}
+
+int mem_segment_start(const struct ProgramSegment *seg) {
+    return seg->start;
+}
+
+int mem_segment_length(const struct ProgramSegment *seg) {
+    return seg->length;
+}
 
-        program_lines[program_line_count] = strdup(line);
-        program_line_count++;
-        lines_loaded++;
+void mem_get_program_usage(int *lines, int *scripts, int *mapped, size_t *text_bytes) {
+    *lines = *scripts = *mapped = 0;
+    *text_bytes = 0;
+    pthread_mutex_lock(&program_mutex);
+    for (struct ProgramSegment *seg = segments; seg != NULL; seg = seg->next) {
+        size_t used, held;
+        arena_usage(&seg->text, &used, &held);
+        *lines += seg->size;
+        *scripts += 1;
+        *mapped += seg->map_base != NULL;
+        *text_bytes += held;
     }
+    pthread_mutex_unlock(&program_mutex);
+}
 
-    return lines_loaded;
-}
\ No newline at end of file
+char *mem_get_program_line(int index) {
+    if (index < 0 || index >= MEM_SIZE) {
+        return NULL;
+    }
+    return program_lines[index];
+}
+
+int mem_get_program_line_count(void) {
+    return program_line_count;
+}
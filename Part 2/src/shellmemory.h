@@ -1,4 +1,16 @@
+#include <stddef.h>
 #define MEM_SIZE 1000
+// Lines of a streamed batch (exec ... #) held in program memory at once
+#define STREAM_WINDOW 64
+// Most scripts one mem_load_start call takes (exec's limit)
+#define LOAD_MANY_MAX 3
+// Loader threads behind mem_load_start
+#define LOADER_THREADS 2
+
+// A loaded script's range of program memory (opaque)
+struct ProgramSegment;
+// Scripts being loaded together (opaque, mem_load_start)
+struct LoadBatch;
 
 /**
  * Initialize shell memory structures
@@ -22,56 +34,158 @@ char *mem_get_value(char *var);
 void mem_set_value(char *var, char *value);
 
 /**
- * Load entire program from file into shell memory.
+ * @return Number of variables set
+ */
+int mem_get_var_count(void);
+
+/**
+ * Program memory in use.
  *
- * Reads all lines from the file and stores them for later execution.
- * Automatically clears any existing program before loading.
+ * @param lines      Receives the number of lines held by loaded scripts
+ *                   (a streamed script holds its window)
+ * @param scripts    Receives the number of loaded scripts
+ * @param mapped     Receives how many of them are mapped .mysc images
+ * @param text_bytes Receives the bytes of arena held for script text
+ */
+void mem_get_program_usage(int *lines, int *scripts, int *mapped, size_t *text_bytes);
+
+/**
+ * Load a script into free program memory as a new segment, alongside the
+ * scripts already loaded. Lines past MEM_SIZE are dropped. A compiled
+ * .mysc image is mapped read-only and its lines used in place; a truncated
+ * or corrupted image fails to load.
+ *
+ * The caller holds the only reference; the segment and its lines are freed
+ * when the last reference is released.
  *
  * @param filename Path to the script file to load
- * @return Number of lines loaded on success, -1 on error
+ * @return The segment, or NULL on error (file not found or out of space)
  */
-int mem_load_program(char *filename);
+struct ProgramSegment *mem_segment_load(char *filename);
 
 /**
- * Get a program line by index.
+ * Start loading several scripts, each into its own segment. Every script
+ * is opened first (a .mysc image is mapped and checked), so a missing or
+ * corrupt script fails the batch before anything is read. The reads then
+ * go to the loader threads; a caller waiting in mem_load_take reads
+ * queued scripts itself.
  *
- * @param index Zero-based index of the line to retrieve
- * @return Pointer to the line string, or NULL if index is invalid
+ * @param filenames Paths of the scripts
+ * @param n         Number of scripts, at most LOAD_MANY_MAX
+ * @return The batch, or NULL if a script could not be opened
  */
-char *mem_get_program_line(int index);
+struct LoadBatch *mem_load_start(char *filenames[], int n);
 
 /**
- * Get the total number of program lines currently loaded.
+ * @param batch Batch from mem_load_start
+ * @param i     Index of a script in the batch
+ * @return Non-zero once script i has been read (mem_load_take won't wait)
+ */
+int mem_load_ready(struct LoadBatch *batch, int i);
+
+/**
+ * Wait until script i has been read and take its segment. Each script is
+ * taken at most once.
  *
- * @return Number of lines in program memory
+ * @param batch Batch from mem_load_start
+ * @param i     Index of a script in the batch
+ * @return The segment (the caller holds its reference), or NULL if it did
+ *         not fit in memory or program memory
  */
-int mem_get_program_line_count(void);
+struct ProgramSegment *mem_load_take(struct LoadBatch *batch, int i);
 
 /**
- * Clear all program lines from memory and free allocated strings.
+ * Wait for the batch's remaining reads, release the segments nobody took
+ * and free the batch.
  *
- * Resets the program line counter to zero. Should be called when
- * a program finishes execution to free memory.
+ * @param batch Batch from mem_load_start
  */
-void mem_clear_program(void);
+void mem_load_finish(struct LoadBatch *batch);
 
 /**
- * Append program lines from file to current program memory (no clear).
- * Used by exec to load multiple scripts contiguously.
+ * Stream the rest of stdin as a new segment. The segment holds a window of
+ * STREAM_WINDOW lines; the first window is read here and later lines as
+ * the script reaches them (mem_segment_extend), each into the slot of a
+ * line that has already run, so input of any length runs in bounded
+ * memory. If stdin already feeds a streamed segment the new one is empty.
  *
- * @param filename Path to the script file to load
- * @return Number of lines appended on success, -1 on error (file not found or out of space)
+ * @return The segment, or NULL on error (out of space)
+ */
+struct ProgramSegment *mem_segment_load_stdin(void);
+
+/**
+ * Make line pc of a segment available if it can be: a streamed segment
+ * reads its next line once every line before pc has run. May block on
+ * input. Only the PCB running the segment may call this.
+ *
+ * @param seg Segment
+ * @param pc  Line about to run
+ * @return Lines of the script known so far; pc is past the end if <= pc
+ */
+int mem_segment_extend(struct ProgramSegment *seg, int pc);
+
+/**
+ * Stop reading a streamed segment (its job was killed). The unread input
+ * is discarded when the segment is freed. Thread-safe; no-op for other
+ * segments.
+ *
+ * @param seg Segment, or NULL
+ */
+void mem_segment_close(struct ProgramSegment *seg);
+
+/**
+ * @param seg   Segment
+ * @param index Line of the script
+ * @return The line, or NULL if past the end. A streamed line stays valid
+ *         until STREAM_WINDOW more lines have been read.
  */
-int mem_append_program(char *filename);
+char *mem_segment_line(const struct ProgramSegment *seg, int index);
 
+/**
+ * @return Non-zero while a streamed segment is reading stdin
+ */
+int mem_stdin_streaming(void);
 
 /**
- * Load remaining program lines from stdin into shell memory.
+ * Take another reference to a segment (a PCB running it).
  *
- * Reads from standard input until EOF and stores each line as a program line.
- * If clear_first is non-zero, clears any existing program lines before loading.
+ * @param seg Segment, or NULL
+ * @return seg
+ */
+struct ProgramSegment *mem_segment_retain(struct ProgramSegment *seg);
+
+/**
+ * Drop a reference. With the last one the segment's lines are returned to
+ * program memory and its text freed. Thread-safe.
  *
- * @param clear_first Non-zero to clear program memory before loading, 0 to append
- * @return Number of lines loaded on success, -1 on error (out of space)
+ * @param seg Segment, or NULL
+ */
+void mem_segment_release(struct ProgramSegment *seg);
+
+/**
+ * @param seg Segment
+ * @return Index of the segment's first line in program memory
+ */
+int mem_segment_start(const struct ProgramSegment *seg);
+
+/**
+ * @param seg Segment
+ * @return Number of lines in the segment
  */
-int mem_load_program_from_stdin(int clear_first);
\ No newline at end of file
+int mem_segment_length(const struct ProgramSegment *seg);
+
+/**
+ * Get a program line by index.
+ *
+ * @param index Zero-based index of the line to retrieve
+ * @return Pointer to the line string, or NULL if index is invalid or free
+ */
+char *mem_get_program_line(int index);
+
+/**
+ * Get one past the highest program line in use.
+ *
+ * @return Number of lines in program memory, counting free lines below the
+ *         last one in use
+ */
+int mem_get_program_line_count(void);
@@ -0,0 +1,313 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "stats.h"
+
+// Metrics of one finished job, copied out of its PCB before it is freed.
+struct JobRecord {
+    int pid;
+    uint64_t arrival_ns;
+    uint64_t first_run_ns;
+    uint64_t completion_ns;
+    uint64_t wait_ns;
+    uint64_t run_ns;
+    int instructions;
+    int slices;
+    int preemptions;
+    int weight;
+    int share_instructions;     // -1 if the job was not live during the share window
+    long deadline;
+    DeadlineUnit deadline_unit;
+    uint64_t arrival_tick;
+    uint64_t completion_tick;
+};
+
+// Finished jobs of the current (or last) top-level schedule
+static struct JobRecord *records = NULL;
+static int record_count = 0;
+static int record_capacity = 0;
+static SchedulePolicy record_policy = POLICY_FCFS;
+static int summary_enabled = 0;
+// Open until the first job of the schedule finishes
+static int share_window_open = 0;
+
+// MT workers finish jobs concurrently
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    // +1 so that a valid timestamp is never 0 ("not yet")
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec + 1;
+}
+
+void stats_schedule_begin(SchedulePolicy policy) {
+    pthread_mutex_lock(&stats_mutex);
+    record_count = 0;
+    record_policy = policy;
+    share_window_open = 1;
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void stats_schedule_end(void) {
+    if (summary_enabled) {
+        stats_report(STATS_TEXT);
+    }
+}
+
+void stats_slice_begin(struct PCB *pcb, uint64_t now) {
+    if (pcb->first_run_ns == 0) {
+        pcb->first_run_ns = now;
+    }
+    if (now > pcb->ready_since_ns) {
+        pcb->wait_ns += now - pcb->ready_since_ns;
+    }
+    pcb->ready_since_ns = now;
+    pcb->slices++;
+}
+
+static void share_snapshot(struct PCB *pcb, void *arg) {
+    (void)arg;
+    pcb->share_instructions = pcb->instructions;
+}
+
+void stats_slice_end(struct PCB *pcb, uint64_t now) {
+    // ready_since_ns holds the slice start until the PCB waits again
+    pcb->run_ns += now - pcb->ready_since_ns;
+    pcb->ready_since_ns = now;
+
+    if (pcb->state == PCB_BLOCKED) {
+        // Gave up the CPU itself (sleep, run): not a preemption
+        return;
+    }
+    if (!pcb_is_done(pcb)) {
+        pcb->preemptions++;
+        return;
+    }
+    pcb->completion_ns = now;
+
+    pthread_mutex_lock(&stats_mutex);
+    if (share_window_open) {
+        // First job to finish: every live job stops counting towards its share
+        share_window_open = 0;
+        pcb_foreach_live(share_snapshot, NULL);
+    }
+    if (record_count == record_capacity) {
+        int cap = record_capacity ? record_capacity * 2 : 16;
+        struct JobRecord *r = realloc(records, cap * sizeof(*r));
+        if (r == NULL) {
+            pthread_mutex_unlock(&stats_mutex);
+            return;
+        }
+        records = r;
+        record_capacity = cap;
+    }
+    struct JobRecord *rec = &records[record_count++];
+    rec->pid = pcb->pid;
+    rec->arrival_ns = pcb->arrival_ns;
+    rec->first_run_ns = pcb->first_run_ns;
+    rec->completion_ns = pcb->completion_ns;
+    rec->wait_ns = pcb->wait_ns;
+    rec->run_ns = pcb->run_ns;
+    rec->instructions = pcb->instructions;
+    rec->slices = pcb->slices;
+    rec->preemptions = pcb->preemptions;
+    rec->weight = pcb->weight;
+    rec->share_instructions = pcb->share_instructions;
+    rec->deadline = pcb->deadline;
+    rec->deadline_unit = pcb->deadline_unit;
+    rec->arrival_tick = pcb->arrival_tick;
+    rec->completion_tick = scheduler_instruction_clock();
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void stats_set_summary(int on) {
+    summary_enabled = on;
+}
+
+static double ns_to_us(uint64_t ns) {
+    return ns / 1000.0;
+}
+
+void stats_report(StatsFormat format) {
+    pthread_mutex_lock(&stats_mutex);
+
+    if (record_count == 0) {
+        pthread_mutex_unlock(&stats_mutex);
+        if (format == STATS_JSON) {
+            printf("{\"policy\":null,\"jobs\":[]}\n");
+        } else if (format == STATS_TEXT) {
+            printf("No scheduling statistics recorded\n");
+        }
+        return;
+    }
+
+    // Aggregates. Times are relative to the earliest arrival.
+    uint64_t origin = records[0].arrival_ns, end = 0;
+    uint64_t sum_turnaround = 0, sum_response = 0, sum_wait = 0;
+    long total_instructions = 0;
+    for (int i = 0; i < record_count; i++) {
+        struct JobRecord *r = &records[i];
+        if (r->arrival_ns < origin) origin = r->arrival_ns;
+        if (r->completion_ns > end) end = r->completion_ns;
+        sum_turnaround += r->completion_ns - r->arrival_ns;
+        sum_response += r->first_run_ns - r->arrival_ns;
+        sum_wait += r->wait_ns;
+        total_instructions += r->instructions;
+    }
+    uint64_t elapsed = end - origin;
+    double seconds = elapsed > 0 ? elapsed / 1e9 : 1e-9;
+    double jobs_per_sec = record_count / seconds;
+    double instr_per_sec = total_instructions / seconds;
+    const char *policy = scheduler_policy_name(record_policy);
+
+    if (format == STATS_CSV) {
+        printf("pid,policy,arrival_ns,first_run_ns,completion_ns,instructions,"
+               "slices,preemptions,turnaround_ns,response_ns,waiting_ns,running_ns\n");
+        for (int i = 0; i < record_count; i++) {
+            struct JobRecord *r = &records[i];
+            printf("%d,%s,%llu,%llu,%llu,%d,%d,%d,%llu,%llu,%llu,%llu\n",
+                   r->pid, policy,
+                   (unsigned long long)(r->arrival_ns - origin),
+                   (unsigned long long)(r->first_run_ns - origin),
+                   (unsigned long long)(r->completion_ns - origin),
+                   r->instructions, r->slices, r->preemptions,
+                   (unsigned long long)(r->completion_ns - r->arrival_ns),
+                   (unsigned long long)(r->first_run_ns - r->arrival_ns),
+                   (unsigned long long)r->wait_ns,
+                   (unsigned long long)r->run_ns);
+        }
+    } else if (format == STATS_JSON) {
+        printf("{\"policy\":\"%s\",\"jobs\":[", policy);
+        for (int i = 0; i < record_count; i++) {
+            struct JobRecord *r = &records[i];
+            printf("%s{\"pid\":%d,\"arrival_ns\":%llu,\"first_run_ns\":%llu,"
+                   "\"completion_ns\":%llu,\"instructions\":%d,\"slices\":%d,"
+                   "\"preemptions\":%d,\"turnaround_ns\":%llu,\"response_ns\":%llu,"
+                   "\"waiting_ns\":%llu,\"running_ns\":%llu}",
+                   i ? "," : "", r->pid,
+                   (unsigned long long)(r->arrival_ns - origin),
+                   (unsigned long long)(r->first_run_ns - origin),
+                   (unsigned long long)(r->completion_ns - origin),
+                   r->instructions, r->slices, r->preemptions,
+                   (unsigned long long)(r->completion_ns - r->arrival_ns),
+                   (unsigned long long)(r->first_run_ns - r->arrival_ns),
+                   (unsigned long long)r->wait_ns,
+                   (unsigned long long)r->run_ns);
+        }
+        printf("],\"aggregate\":{\"jobs\":%d,\"instructions\":%ld,\"elapsed_ns\":%llu,"
+               "\"avg_turnaround_ns\":%llu,\"avg_response_ns\":%llu,\"avg_waiting_ns\":%llu,"
+               "\"jobs_per_sec\":%.1f,\"instructions_per_sec\":%.1f}}\n",
+               record_count, total_instructions, (unsigned long long)elapsed,
+               (unsigned long long)(sum_turnaround / record_count),
+               (unsigned long long)(sum_response / record_count),
+               (unsigned long long)(sum_wait / record_count),
+               jobs_per_sec, instr_per_sec);
+    } else {
+        printf("Schedule: %s, %d jobs\n", policy, record_count);
+        printf("PID\tINSTR\tSLICES\tPREEMPT\tTURNAROUND(us)\tRESPONSE(us)\tWAITING(us)\n");
+        for (int i = 0; i < record_count; i++) {
+            struct JobRecord *r = &records[i];
+            printf("%d\t%d\t%d\t%d\t%.3f\t%.3f\t%.3f\n",
+                   r->pid, r->instructions, r->slices, r->preemptions,
+                   ns_to_us(r->completion_ns - r->arrival_ns),
+                   ns_to_us(r->first_run_ns - r->arrival_ns),
+                   ns_to_us(r->wait_ns));
+        }
+        printf("Average turnaround %.3f us, response %.3f us, waiting %.3f us\n",
+               ns_to_us(sum_turnaround / record_count),
+               ns_to_us(sum_response / record_count),
+               ns_to_us(sum_wait / record_count));
+        printf("Throughput %.1f jobs/s, %.1f instructions/s over %.3f us\n",
+               jobs_per_sec, instr_per_sec, ns_to_us(elapsed));
+    }
+
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void stats_share_report(void) {
+    pthread_mutex_lock(&stats_mutex);
+
+    long window = 0, total_weight = 0;
+    for (int i = 0; i < record_count; i++) {
+        if (records[i].share_instructions >= 0) {
+            window += records[i].share_instructions;
+            total_weight += records[i].weight;
+        }
+    }
+    if (window == 0) {
+        pthread_mutex_unlock(&stats_mutex);
+        return;
+    }
+
+    printf("Share report: %s, %ld instructions while all jobs were runnable\n",
+           scheduler_policy_name(record_policy), window);
+    printf("PID\tWEIGHT\tREQUESTED\tACHIEVED\tERROR(instr)\n");
+    double max_error = 0;
+    for (int i = 0; i < record_count; i++) {
+        struct JobRecord *r = &records[i];
+        if (r->share_instructions < 0) {
+            continue;
+        }
+        double requested = (double)r->weight / total_weight;
+        double achieved = (double)r->share_instructions / window;
+        double error = r->share_instructions - requested * window;
+        if (error < 0 ? -error > max_error : error > max_error) {
+            max_error = error < 0 ? -error : error;
+        }
+        printf("%d\t%d\t%.1f%%\t\t%.1f%%\t\t%+.2f\n",
+               r->pid, r->weight, requested * 100, achieved * 100, error);
+    }
+    printf("Max fairness error: %.2f instructions\n", max_error);
+
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+void stats_deadline_report(void) {
+    pthread_mutex_lock(&stats_mutex);
+
+    int jobs = 0, met = 0, unit_ms = 0;
+    double max_lateness = 0;
+    for (int i = 0; i < record_count; i++) {
+        struct JobRecord *r = &records[i];
+        if (r->deadline_unit == DEADLINE_NONE) {
+            continue;
+        }
+        // Instruction deadlines are exact; millisecond ones are wall time
+        int ms = r->deadline_unit == DEADLINE_MS;
+        unit_ms = ms;
+        const char *unit = ms ? "ms" : "";
+        double finished = ms ? (r->completion_ns - r->arrival_ns) / 1e6
+                             : (double)(r->completion_tick - r->arrival_tick);
+        double lateness = finished - r->deadline;
+
+        if (jobs == 0) {
+            printf("Deadline report: %s\n", scheduler_policy_name(record_policy));
+            printf("PID\tDEADLINE\tFINISHED\tLATENESS\tRESULT\n");
+        }
+        if (jobs == 0 || lateness > max_lateness) {
+            max_lateness = lateness;
+        }
+        jobs++;
+        if (lateness <= 0) {
+            met++;
+        }
+        if (ms) {
+            printf("%d\t%ld%s\t\t%.3f%s\t\t%+.3f%s\t%s\n", r->pid, r->deadline, unit,
+                   finished, unit, lateness, unit, lateness <= 0 ? "met" : "missed");
+        } else {
+            printf("%d\t%ld\t\t%.0f\t\t%+.0f\t\t%s\n", r->pid, r->deadline,
+                   finished, lateness, lateness <= 0 ? "met" : "missed");
+        }
+    }
+    if (jobs > 0 && unit_ms) {
+        printf("Deadlines met %d/%d, missed %d, max lateness %+.3fms\n",
+               met, jobs, jobs - met, max_lateness);
+    } else if (jobs > 0) {
+        printf("Deadlines met %d/%d, missed %d, max lateness %+.0f\n",
+               met, jobs, jobs - met, max_lateness);
+    }
+
+    pthread_mutex_unlock(&stats_mutex);
+}
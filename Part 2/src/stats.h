@@ -0,0 +1,82 @@
+#ifndef STATS_H
+#define STATS_H
+#include <stdint.h>
+#include "scheduler.h"
+
+/**
+ * Output formats for the stats report.
+ */
+typedef enum {
+    STATS_TEXT,
+    STATS_CSV,
+    STATS_JSON
+} StatsFormat;
+
+/**
+ * Read the monotonic clock.
+ *
+ * @return Nanoseconds since an arbitrary fixed point (never 0)
+ */
+uint64_t stats_now(void);
+
+/**
+ * Start a new top-level schedule: forget the jobs recorded so far.
+ *
+ * @param policy Policy the schedule runs under (shown in reports)
+ */
+void stats_schedule_begin(SchedulePolicy policy);
+
+/**
+ * Mark the end of a top-level schedule. Prints the text report when the
+ * end-of-exec summary is enabled (stats summary on).
+ */
+void stats_schedule_end(void);
+
+/**
+ * Account for the start of a time slice.
+ *
+ * @param pcb PCB about to run
+ * @param now Current stats_now() value
+ */
+void stats_slice_begin(struct PCB *pcb, uint64_t now);
+
+/**
+ * Account for the end of a time slice. If the PCB is done its metrics are
+ * copied into the report for the current schedule; otherwise the slice
+ * counts as a preemption and the PCB starts waiting again.
+ *
+ * @param pcb PCB that just ran
+ * @param now Current stats_now() value (reuse it as the next slice's start)
+ */
+void stats_slice_end(struct PCB *pcb, uint64_t now);
+
+/**
+ * Enable or disable the report printed at the end of each schedule.
+ *
+ * @param on Non-zero to enable
+ */
+void stats_set_summary(int on);
+
+/**
+ * Print per-job and aggregate metrics for the current/last schedule.
+ *
+ * @param format Text table, CSV or JSON
+ */
+void stats_report(StatsFormat format);
+
+/**
+ * Print requested vs achieved CPU share of the jobs that competed in the
+ * current/last schedule (STRIDE, LOTTERY). Shares are measured over the
+ * contention window: from the start of the schedule until its first job
+ * finished, while every job was runnable.
+ */
+void stats_share_report(void);
+
+/**
+ * Print, for every job of the current/last schedule that had an EDF
+ * deadline, whether it finished by its deadline and its lateness
+ * (completion minus deadline, negative when early), in the deadline's unit.
+ */
+void stats_deadline_report(void);
+
+#endif // STATS_H
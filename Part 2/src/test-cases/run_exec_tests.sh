@@ -4,7 +4,7 @@
 
 set -e
 MYSH="../mysh"
-TESTS="T_exec_single T_exec_two T_exec_invalid_policy T_exec_usage_few T_exec_usage_many T_exec_duplicate T_exec_notfound T_exec_policies T_FCFS T_SJF T_RR T_AGING"
+TESTS="T_exec_single T_exec_two T_exec_invalid_policy T_exec_usage_few T_exec_usage_many T_exec_duplicate T_exec_notfound T_exec_load T_exec_policies T_FCFS T_SJF T_SJF_EST T_RR T_AGING T_STRIDE T_LOTTERY T_FAIR T_EDF T_JOBS T_SLEEP T_RUN T_HASH T_PIPE T_LSCACHE T_WALK T_MYSC T_PROFILE T_MEMINFO T_SEGMENTS T_STREAM T_ASYNC T_STATS T_TRACE"
 
 for t in $TESTS; do
   if [ ! -f "${t}.txt" ]; then
@@ -15,8 +15,19 @@ for t in $TESTS; do
     echo "SKIP ${t} (no ${t}_result.txt)"
     continue
   fi
+  # Per-test environment: one VAR=value per line in T_name.env
+  envs=()
+  if [ -f "${t}.env" ]; then
+    mapfile -t envs < "${t}.env"
+  fi
+  # Per-test output filter: a sed -E script in T_name.mask that replaces
+  # timings, sizes and paths that differ between runs
+  mask="s/^//"
+  if [ -f "${t}.mask" ]; then
+    mask=$(cat "${t}.mask")
+  fi
   out=$(mktemp)
-  $MYSH < "${t}.txt" 2>/dev/null > "$out" || true
+  env "${envs[@]}" $MYSH < "${t}.txt" 2>/dev/null | sed -E "$mask" > "$out" || true
   if diff -q "$out" "${t}_result.txt" > /dev/null 2>&1; then
     echo "PASS ${t}"
   else
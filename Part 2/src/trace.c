@@ -0,0 +1,151 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "trace.h"
+#include "stats.h"
+
+// Events kept per thread; older events are overwritten. Must be a power of 2.
+#define TRACE_RING_SIZE 65536
+
+struct TraceRecord {
+    uint64_t ts_ns;
+    int pid;
+    int arg;
+    int ev;
+};
+
+// One ring per thread that has recorded an event. Only the owning thread
+// writes records and head; readers load head with acquire ordering.
+struct TraceRing {
+    struct TraceRecord records[TRACE_RING_SIZE];
+    uint64_t head;              // Total records ever written
+    uint64_t base;              // head at the last trace_start()
+    int worker;
+    struct TraceRing *next;     // All rings, for trace_dump
+};
+
+int trace_enabled = 0;
+
+static __thread struct TraceRing *my_ring = NULL;
+static __thread int my_worker = 0;
+
+// Ring list; the lock is only taken when a thread creates its ring,
+// and by trace_start/trace_dump.
+static struct TraceRing *rings = NULL;
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *event_names[] = {
+    "enqueue", "dequeue", "slice", "slice", "preempt", "age", "free"
+};
+
+static struct TraceRing *trace_ring_create(void) {
+    struct TraceRing *ring = calloc(1, sizeof(struct TraceRing));
+    if (ring == NULL) {
+        return NULL;
+    }
+    ring->worker = my_worker;
+
+    pthread_mutex_lock(&rings_mutex);
+    ring->next = rings;
+    rings = ring;
+    pthread_mutex_unlock(&rings_mutex);
+    return ring;
+}
+
+void trace_record(TraceEvent ev, int pid, int arg) {
+    struct TraceRing *ring = my_ring;
+    if (ring == NULL) {
+        ring = my_ring = trace_ring_create();
+        if (ring == NULL) {
+            return;
+        }
+    }
+
+    uint64_t head = ring->head;
+    struct TraceRecord *r = &ring->records[head & (TRACE_RING_SIZE - 1)];
+    r->ts_ns = stats_now();
+    r->pid = pid;
+    r->arg = arg;
+    r->ev = ev;
+    // Publish the record before the new head becomes visible to trace_dump
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_set_worker(int id) {
+    my_worker = id;
+    if (my_ring != NULL) {
+        my_ring->worker = id;
+    }
+}
+
+void trace_start(void) {
+    pthread_mutex_lock(&rings_mutex);
+    for (struct TraceRing *ring = rings; ring != NULL; ring = ring->next) {
+        ring->base = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    }
+    pthread_mutex_unlock(&rings_mutex);
+    __atomic_store_n(&trace_enabled, 1, __ATOMIC_RELAXED);
+}
+
+void trace_stop(void) {
+    __atomic_store_n(&trace_enabled, 0, __ATOMIC_RELAXED);
+}
+
+int trace_dump(const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (f == NULL) {
+        return -1;
+    }
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    int first = 1;
+
+    pthread_mutex_lock(&rings_mutex);
+    for (struct TraceRing *ring = rings; ring != NULL; ring = ring->next) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t start = ring->base;
+        if (head - start > TRACE_RING_SIZE) {
+            start = head - TRACE_RING_SIZE;
+        }
+        if (start == head) {
+            continue;
+        }
+
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"name\":\"%s %d\"}}",
+                first ? "" : ",\n", ring->worker,
+                ring->worker == 0 ? "main"
+                : ring->worker == TRACE_WORKER_ASYNC ? "async" : "worker", ring->worker);
+        first = 0;
+
+        for (uint64_t i = start; i < head; i++) {
+            struct TraceRecord *r = &ring->records[i & (TRACE_RING_SIZE - 1)];
+            double ts_us = r->ts_ns / 1000.0;
+            switch (r->ev) {
+            case TRACE_SLICE_START:
+                fprintf(f, ",\n{\"name\":\"pid %d\",\"cat\":\"slice\",\"ph\":\"B\","
+                        "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"pcb\":%d}}",
+                        r->pid, ts_us, ring->worker, r->pid);
+                break;
+            case TRACE_SLICE_END:
+                fprintf(f, ",\n{\"name\":\"pid %d\",\"cat\":\"slice\",\"ph\":\"E\","
+                        "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"instructions\":%d}}",
+                        r->pid, ts_us, ring->worker, r->arg);
+                break;
+            default:
+                fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"queue\",\"ph\":\"i\",\"s\":\"t\","
+                        "\"ts\":%.3f,\"pid\":1,\"tid\":%d,\"args\":{\"pcb\":%d,\"value\":%d}}",
+                        event_names[r->ev], ts_us, ring->worker, r->pid, r->arg);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&rings_mutex);
+
+    fprintf(f, "\n]}\n");
+    if (fclose(f) != 0) {
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/**
+ * Scheduler events recorded by the tracer.
+ */
+typedef enum {
+    TRACE_ENQUEUE,
+    TRACE_DEQUEUE,
+    TRACE_SLICE_START,
+    TRACE_SLICE_END,
+    TRACE_PREEMPT,
+    TRACE_AGE,
+    TRACE_FREE
+} TraceEvent;
+
+// Non-zero while tracing is on. Read and written only through relaxed
+// __atomic builtins: TRACE() checks it on every thread without a lock.
+extern int trace_enabled;
+
+/**
+ * Record a scheduler event if tracing is on. Costs one branch when off.
+ *
+ * @param ev  TraceEvent
+ * @param pid PID of the PCB the event is about
+ * @param arg Event-specific value (AGING score, instructions run, ...)
+ */
+#define TRACE(ev, pid, arg) \
+    do { \
+        if (__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)) \
+            trace_record((ev), (pid), (arg)); \
+    } while (0)
+
+/**
+ * Append an event to the calling thread's ring buffer.
+ * Each thread writes only its own ring, so no lock is taken.
+ * Use TRACE() instead of calling this directly.
+ */
+void trace_record(TraceEvent ev, int pid, int arg);
+
+// Worker id of the background exec thread (exec ... # at a terminal),
+// after the two MT workers
+#define TRACE_WORKER_ASYNC 3
+
+/**
+ * Set the worker id reported for events from the calling thread.
+ * The main thread is worker 0; MT workers are numbered from 1; the
+ * background exec thread is TRACE_WORKER_ASYNC.
+ *
+ * @param id Worker id
+ */
+void trace_set_worker(int id);
+
+/**
+ * Discard recorded events and start tracing.
+ */
+void trace_start(void);
+
+/**
+ * Stop tracing. Recorded events are kept until the next trace_start().
+ */
+void trace_stop(void);
+
+/**
+ * Write all recorded events in Chrome trace-event JSON format
+ * (load in chrome://tracing or Perfetto).
+ *
+ * @param filename Output file
+ * @return 0 on success, -1 if the file could not be written
+ */
+int trace_dump(const char *filename);
+
+#endif // TRACE_H
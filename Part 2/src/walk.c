@@ -0,0 +1,408 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "walk.h"
+#include "listing.h"
+
+// One directory of the tree. Workers fill in fd, listing and children;
+// printing happens once every node has been read.
+struct WalkNode {
+    struct WalkNode *parent;
+    const char *name;           // Points into the parent's listing (root: the path given)
+    int fd;                     // Open until every subdirectory has opened itself from it
+    int pending;                // Subdirectories yet to open, + 1 while being read
+    int err;                    // errno if the directory could not be read, else 0
+    struct Listing listing;
+    struct WalkNode **children; // Per listing entry: the subdirectory's node, or NULL
+};
+
+// Work-stealing deque of directories to read. The owner pushes and pops at
+// the tail (depth first, so few directories hold an open fd at once);
+// idle workers steal from the head (the shallowest, largest subtrees).
+struct WalkQueue {
+    pthread_mutex_t lock;
+    struct WalkNode **items;
+    int head, tail, capacity;
+};
+
+struct Walk {
+    int threads;
+    struct WalkQueue queues[WALK_THREADS_MAX];
+    int outstanding;            // Directories pushed but not read yet
+    // Idle workers wait on idle_cond; pushes and the last read signal it
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+};
+
+struct WalkWorker {
+    struct Walk *walk;
+    int id;
+};
+
+// Same rule as ls_filter: names starting with '.' are hidden
+static int walk_hidden(const char *name) {
+    return name[0] == '.';
+}
+
+static int queue_push(struct WalkQueue *q, struct WalkNode *node) {
+    pthread_mutex_lock(&q->lock);
+    if (q->tail == q->capacity) {
+        if (q->head > 0) {
+            memmove(q->items, q->items + q->head, (q->tail - q->head) * sizeof(*q->items));
+            q->tail -= q->head;
+            q->head = 0;
+        } else {
+            int capacity = q->capacity ? q->capacity * 2 : 64;
+            struct WalkNode **items = realloc(q->items, capacity * sizeof(*items));
+            if (items == NULL) {
+                pthread_mutex_unlock(&q->lock);
+                return -1;
+            }
+            q->items = items;
+            q->capacity = capacity;
+        }
+    }
+    q->items[q->tail++] = node;
+    pthread_mutex_unlock(&q->lock);
+    return 0;
+}
+
+static struct WalkNode *queue_pop(struct WalkQueue *q) {
+    struct WalkNode *node = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) {
+        node = q->items[--q->tail];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return node;
+}
+
+static struct WalkNode *queue_steal(struct WalkQueue *q) {
+    struct WalkNode *node = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail > q->head) {
+        node = q->items[q->head++];
+    }
+    pthread_mutex_unlock(&q->lock);
+    return node;
+}
+
+// Wake idle workers: there is work to steal, or the walk is over
+static void walk_wake(struct Walk *walk) {
+    pthread_mutex_lock(&walk->idle_lock);
+    pthread_cond_broadcast(&walk->idle_cond);
+    pthread_mutex_unlock(&walk->idle_lock);
+}
+
+// Drop one hold on a node's fd; the last one closes it
+static void node_release(struct WalkNode *node) {
+    if (__atomic_sub_fetch(&node->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        close(node->fd);
+        node->fd = -1;
+    }
+}
+
+static int entry_is_dir(int dirfd, const struct ListingEntry *e) {
+    if (e->type != DT_UNKNOWN) {
+        return e->type == DT_DIR;
+    }
+    // Some file systems do not fill in d_type
+    struct stat st;
+    return fstatat(dirfd, e->name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+
+static void walk_read(struct Walk *walk, int id, struct WalkNode *node) {
+    if (node->parent != NULL) {
+        node->fd = openat(node->parent->fd, node->name,
+                          O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (node->fd < 0) {
+            node->err = errno;
+        }
+        node_release(node->parent);
+    }
+    if (node->err != 0) {
+        return;
+    }
+    if (listing_read(node->fd, &node->listing) != 0) {
+        node->err = errno;
+        close(node->fd);
+        node->fd = -1;
+        return;
+    }
+
+    int count = node->listing.count;
+    node->children = calloc(count ? count : 1, sizeof(*node->children));
+    if (node->children == NULL) {
+        listing_free(&node->listing);
+        node->err = ENOMEM;
+        close(node->fd);
+        node->fd = -1;
+        return;
+    }
+    int subdirs = 0;
+    for (int i = 0; i < count; i++) {
+        const struct ListingEntry *e = &node->listing.entries[i];
+        if (!walk_hidden(e->name) && entry_is_dir(node->fd, e)) {
+            node->children[i] = calloc(1, sizeof(struct WalkNode));
+            if (node->children[i] == NULL) {
+                break;
+            }
+            node->children[i]->parent = node;
+            node->children[i]->name = e->name;
+            node->children[i]->fd = -1;
+            subdirs++;
+        }
+    }
+
+    // Set the holds before any child can run and release one
+    node->pending = subdirs + 1;
+    int pushed = 0;
+    for (int i = 0; i < count && subdirs > 0; i++) {
+        if (node->children[i] != NULL) {
+            __atomic_add_fetch(&walk->outstanding, 1, __ATOMIC_RELEASE);
+            if (queue_push(&walk->queues[id], node->children[i]) != 0) {
+                // Out of memory: report the subdirectory as unreadable
+                node->children[i]->err = ENOMEM;
+                __atomic_sub_fetch(&walk->outstanding, 1, __ATOMIC_RELEASE);
+                node_release(node);
+            } else {
+                pushed = 1;
+            }
+            subdirs--;
+        }
+    }
+    if (pushed) {
+        walk_wake(walk);
+    }
+    node_release(node);
+}
+
+// Next directory for worker id: its own newest, else the oldest of another
+static struct WalkNode *walk_take(struct Walk *walk, int id) {
+    struct WalkNode *node = queue_pop(&walk->queues[id]);
+    for (int i = 1; node == NULL && i < walk->threads; i++) {
+        node = queue_steal(&walk->queues[(id + i) % walk->threads]);
+    }
+    return node;
+}
+
+static void *walk_worker(void *arg) {
+    struct WalkWorker *w = arg;
+    struct Walk *walk = w->walk;
+    while (1) {
+        struct WalkNode *node = walk_take(walk, w->id);
+        if (node == NULL) {
+            // Others are still reading: sleep until they push or finish.
+            // Checking again under idle_lock means no wake is missed.
+            pthread_mutex_lock(&walk->idle_lock);
+            while ((node = walk_take(walk, w->id)) == NULL
+                   && __atomic_load_n(&walk->outstanding, __ATOMIC_ACQUIRE) > 0) {
+                pthread_cond_wait(&walk->idle_cond, &walk->idle_lock);
+            }
+            pthread_mutex_unlock(&walk->idle_lock);
+            if (node == NULL) {
+                break;
+            }
+        }
+        walk_read(walk, w->id, node);
+        if (__atomic_sub_fetch(&walk->outstanding, 1, __ATOMIC_ACQ_REL) == 0) {
+            walk_wake(walk);
+        }
+    }
+    return NULL;
+}
+
+static void node_free(struct WalkNode *node) {
+    if (node->children != NULL) {
+        for (int i = 0; i < node->listing.count; i++) {
+            if (node->children[i] != NULL) {
+                node_free(node->children[i]);
+            }
+        }
+        free(node->children);
+    }
+    if (node->err == 0) {
+        listing_free(&node->listing);
+    }
+    if (node->parent != NULL) {
+        free(node);
+    }
+}
+
+// Read the whole tree below root into nodes
+static int walk_tree(const char *root, struct WalkNode *top) {
+    memset(top, 0, sizeof(*top));
+    top->name = root;
+    top->fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (top->fd < 0) {
+        return -1;
+    }
+
+    struct Walk walk;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    walk.threads = cpus < 1 ? 1 : cpus > WALK_THREADS_MAX ? WALK_THREADS_MAX : cpus;
+    for (int i = 0; i < walk.threads; i++) {
+        pthread_mutex_init(&walk.queues[i].lock, NULL);
+        walk.queues[i].items = NULL;
+        walk.queues[i].head = walk.queues[i].tail = walk.queues[i].capacity = 0;
+    }
+    walk.outstanding = 1;
+    pthread_mutex_init(&walk.idle_lock, NULL);
+    pthread_cond_init(&walk.idle_cond, NULL);
+    if (queue_push(&walk.queues[0], top) != 0) {
+        close(top->fd);
+        pthread_mutex_destroy(&walk.queues[0].lock);
+        pthread_mutex_destroy(&walk.idle_lock);
+        pthread_cond_destroy(&walk.idle_cond);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    pthread_t tids[WALK_THREADS_MAX];
+    struct WalkWorker workers[WALK_THREADS_MAX];
+    int started = 1;
+    for (int i = 0; i < walk.threads; i++) {
+        workers[i].walk = &walk;
+        workers[i].id = i;
+    }
+    for (int i = 1; i < walk.threads; i++) {
+        if (pthread_create(&tids[i], NULL, walk_worker, &workers[i]) != 0) {
+            break;      // fewer helpers; the others steal its work
+        }
+        started++;
+    }
+    walk_worker(&workers[0]);
+    for (int i = 1; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    for (int i = 0; i < walk.threads; i++) {
+        pthread_mutex_destroy(&walk.queues[i].lock);
+        free(walk.queues[i].items);
+    }
+    pthread_mutex_destroy(&walk.idle_lock);
+    pthread_cond_destroy(&walk.idle_cond);
+
+    if (top->err != 0) {
+        errno = top->err;
+        node_free(top);
+        return -1;
+    }
+    return 0;
+}
+
+// Growable path for printing
+struct WalkPath {
+    char *s;
+    size_t len, capacity;
+};
+
+static int path_push(struct WalkPath *p, const char *name) {
+    size_t n = strlen(name);
+    if (p->len + n + 2 > p->capacity) {
+        size_t capacity = (p->len + n + 2) * 2;
+        char *s = realloc(p->s, capacity);
+        if (s == NULL) {
+            return -1;
+        }
+        p->s = s;
+        p->capacity = capacity;
+    }
+    if (p->len > 0) {
+        p->s[p->len++] = '/';
+    }
+    memcpy(p->s + p->len, name, n + 1);
+    p->len += n;
+    return 0;
+}
+
+static void path_pop(struct WalkPath *p, size_t len) {
+    p->len = len;
+    p->s[len] = '\0';
+}
+
+static void print_tree(struct WalkNode *node, struct WalkPath *path, int first, FILE *out) {
+    if (!first) {
+        fputc('\n', out);
+    }
+    fprintf(out, "%s:\n", path->s);
+    if (node->err != 0) {
+        fprintf(stderr, "my_ls: %s: %s\n", path->s, strerror(node->err));
+        return;
+    }
+    for (int i = 0; i < node->listing.count; i++) {
+        const struct ListingEntry *e = &node->listing.entries[i];
+        if (!walk_hidden(e->name)) {
+            fwrite(e->name, 1, e->name_len, out);
+            fputc('\n', out);
+        }
+    }
+    for (int i = 0; i < node->listing.count; i++) {
+        if (node->children[i] != NULL) {
+            size_t len = path->len;
+            if (path_push(path, node->children[i]->name) == 0) {
+                print_tree(node->children[i], path, 0, out);
+                path_pop(path, len);
+            }
+        }
+    }
+}
+
+static void print_matches(struct WalkNode *node, struct WalkPath *path,
+                          const char *pattern, FILE *out) {
+    if (node->err != 0) {
+        fprintf(stderr, "my_find: %s: %s\n", path->s, strerror(node->err));
+        return;
+    }
+    for (int i = 0; i < node->listing.count; i++) {
+        const struct ListingEntry *e = &node->listing.entries[i];
+        if (walk_hidden(e->name)) {
+            continue;
+        }
+        size_t len = path->len;
+        if (path_push(path, e->name) != 0) {
+            continue;
+        }
+        if (fnmatch(pattern, e->name, 0) == 0) {
+            fwrite(path->s, 1, path->len, out);
+            fputc('\n', out);
+        }
+        if (node->children[i] != NULL) {
+            print_matches(node->children[i], path, pattern, out);
+        }
+        path_pop(path, len);
+    }
+}
+
+int walk_list(const char *root, FILE *out) {
+    struct WalkNode top;
+    if (walk_tree(root, &top) != 0) {
+        return -1;
+    }
+    struct WalkPath path = { NULL, 0, 0 };
+    if (path_push(&path, root) == 0) {
+        print_tree(&top, &path, 1, out);
+    }
+    free(path.s);
+    node_free(&top);
+    return 0;
+}
+
+int walk_find(const char *root, const char *pattern, FILE *out) {
+    struct WalkNode top;
+    if (walk_tree(root, &top) != 0) {
+        return -1;
+    }
+    struct WalkPath path = { NULL, 0, 0 };
+    if (path_push(&path, root) == 0) {
+        print_matches(&top, &path, pattern, out);
+    }
+    free(path.s);
+    node_free(&top);
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef WALK_H
+#define WALK_H
+#include <stdio.h>
+
+// Most threads a tree walk uses (fewer on machines with fewer CPUs)
+#define WALK_THREADS_MAX 8
+
+/**
+ * List a directory tree like ls -R: a "PATH:" header per directory,
+ * followed by its entries in my_ls order, directories separated by a blank
+ * line. Dotfiles are skipped and symbolic links are not followed.
+ * Directories are read in parallel by a work-stealing thread pool; the
+ * output is printed afterwards, in sorted depth-first order, so it does not
+ * depend on thread timing.
+ *
+ * @param root Directory to start from
+ * @param out  Stream to write to
+ * @return 0 on success, -1 if root could not be read (errors below root
+ *         are reported on stderr and skipped)
+ */
+int walk_list(const char *root, FILE *out);
+
+/**
+ * Print the path of every entry below root whose name matches a glob
+ * pattern (fnmatch), in the same sorted depth-first order as walk_list.
+ *
+ * @param root    Directory to start from
+ * @param pattern Name to look for, may contain * ? [...]
+ * @param out     Stream to write to
+ * @return 0 on success, -1 if root could not be read
+ */
+int walk_find(const char *root, const char *pattern, FILE *out);
+
+#endif // WALK_H